@@ -39,11 +39,13 @@ SOFTWARE.
 
 typedef std::uint64_t u64;
 typedef std::uint32_t u32;
+typedef std::uint16_t u16;
 typedef std::uint8_t u8;
 typedef std::uint32_t Move;
 
 constexpr int MAX_THREADS = 64;
 constexpr int MAX_PLY = 128;
+constexpr int MAX_MOVES = 256;
 constexpr int MAX_PHASE = 256;
 constexpr int INFINITY = 30000;
 constexpr int MATE = 29000;
@@ -67,7 +69,7 @@ enum GamePhase
 
 enum Color
 {
-    US, THEM,
+    WHITE, BLACK,
     NUM_COLORS
 };
 
@@ -110,8 +112,8 @@ enum CastlingType
 
 enum CastlingRights
 {
-    US_OO = 1, US_OOO = 2,
-    THEM_OO = 4, THEM_OOO = 8
+    WHITE_OO = 1, WHITE_OOO = 2,
+    BLACK_OO = 4, BLACK_OOO = 8
 };
 
 enum Bound
@@ -121,16 +123,28 @@ enum Bound
     EXACT_BOUND
 };
 
-inline int get_sq(int file, int rank) { return (rank << 3) ^ file; }
-inline int rank_of(int sq) { return sq >> 3; }
-inline int file_of(int sq) { return sq & 7; }
+constexpr int get_sq(int file, int rank) { return (rank << 3) ^ file; }
+constexpr int rank_of(int sq) { return sq >> 3; }
+constexpr int file_of(int sq) { return sq & 7; }
+constexpr int relative_sq(int c, int sq) { return sq ^ (c * 56); }
+constexpr int relative_rank(int c, int sq) { return (sq >> 3) ^ (c * 7); }
 
-inline int popcnt(u64 bb) { return __builtin_popcountll(bb); }
-inline int fbitscan(u64 bb) { return __builtin_ctzll(bb); }
-inline int rbitscan(u64 bb) { return 63 - __builtin_clzll(bb); }
+constexpr int popcnt(u64 bb) { return __builtin_popcountll(bb); }
+constexpr int fbitscan(u64 bb) { return __builtin_ctzll(bb); }
+constexpr int rbitscan(u64 bb) { return 63 - __builtin_clzll(bb); }
 
-inline u64 BB(int shift) { return u64(1) << shift; }
-inline u64 sBB(int shift) { return shift < 64 ? u64(1) << shift : 0; }
+constexpr u64 BB(int shift) { return u64(1) << shift; }
+constexpr u64 sBB(int shift) { return shift >= 0 && shift < 64 ? u64(1) << shift : 0; }
+
+// Shift a bitboard by a signed amount, positive values shift towards H8
+template <int shift>
+inline u64 shift_bb(u64 bb)
+{
+    if constexpr (shift > 0)
+        return bb << shift;
+    else
+        return bb >> -shift;
+}
 
 extern void print_bb(u64 bb);
 
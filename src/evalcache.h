@@ -0,0 +1,80 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef EVALCACHE_H
+#define EVALCACHE_H
+
+#include <atomic>
+#include <memory>
+
+#include "definitions.h"
+
+// Static evals by position key. Each entry keeps the upper 48 bits of the
+// key with the eval in the low 16 bits, and every search thread has its own
+// cache. The entries are allocated on the first search using the thread.
+class EvalCache
+{
+public:
+    void allocate();
+    bool allocated() const;
+    bool probe(u64 key, int& eval) const;
+    void store(u64 key, int eval);
+
+private:
+    static constexpr u64 SIZE = 1 << 16;
+    static constexpr u64 EVAL_MASK = 0xffff;
+
+    std::unique_ptr<u64[]> entries;
+};
+
+namespace evalcache
+{
+    STATS(
+            inline std::atomic<u64> hits;
+            inline std::atomic<u64> misses;
+         )
+}
+
+inline void EvalCache::allocate() { this->entries = std::make_unique<u64[]>(SIZE); }
+inline bool EvalCache::allocated() const { return bool(this->entries); }
+
+inline bool EvalCache::probe(u64 key, int& eval) const
+{
+    u64 entry = this->entries[key & (SIZE - 1)];
+    if ((entry ^ key) & ~EVAL_MASK)
+    {
+        STATS(++evalcache::misses;)
+        return false;
+    }
+    STATS(++evalcache::hits;)
+    eval = std::int16_t(entry & EVAL_MASK);
+    return true;
+}
+
+inline void EvalCache::store(u64 key, int eval)
+{
+    this->entries[key & (SIZE - 1)] = (key & ~EVAL_MASK) | u16(eval);
+}
+
+#endif
@@ -25,6 +25,7 @@ SOFTWARE.
 #include "position.h"
 #include "utils.h"
 #include "evaluate.h"
+#include "material.h"
 
 enum PassedPawnType
 {
@@ -36,63 +37,58 @@ enum PassedPawnType
 
 struct Evaluator
 {
-    Evaluator(Position&);
+    Evaluator(Position&, EvalTables&);
     int evaluate();
 
 private:
-    int get_game_phase();
-    Score eval_pawns();
-    Score eval_pieces();
-    Score eval_passed_pawns();
-    Score eval_king();
+    Score eval_pawn_structure();
+    template <Color Strong> int eval_kxk(const MaterialEntry& material);
+    template <Color Us> Score eval_pawns();
+    template <Color Us> Score eval_pieces();
+    template <Color Us> Score eval_passed_pawns();
+    template <Color Us> Score eval_king();
 
     // Data members
-    int side;
     int king_attacks[2];
     u64 blocked_pawn_bb[2];
     u64 passed_pawn_bb[2];
     u64 attacked_by[2][8];
     Position& pos;
+    EvalTables& tables;
 };
 
-Evaluator::Evaluator(Position& pos) : pos(pos)
+Evaluator::Evaluator(Position& pos, EvalTables& tables)
+    : pos(pos), tables(tables)
 {
-    king_attacks[US] = king_attacks[THEM] = 0;
-    blocked_pawn_bb[US] = blocked_pawn_bb[THEM] = 0;
-    passed_pawn_bb[US] = passed_pawn_bb[THEM] = 0;
-    attacked_by[US][ALL_PIECES] = attacked_by[THEM][ALL_PIECES] = 0;
+    king_attacks[WHITE] = king_attacks[BLACK] = 0;
+    blocked_pawn_bb[WHITE] = blocked_pawn_bb[BLACK] = 0;
+    passed_pawn_bb[WHITE] = passed_pawn_bb[BLACK] = 0;
+    attacked_by[WHITE][ALL_PIECES] = attacked_by[BLACK][ALL_PIECES] = 0;
     for (int pt = PAWN; pt <= KING; ++pt)
-        attacked_by[US][pt] = attacked_by[THEM][pt] = 0;
-}
-
-int Evaluator::get_game_phase()
-{
-    int phase = 0;
-    for (int pt = PAWN; pt < KING; ++pt)
-        phase += piece_phase[pt] * popcnt(pos.piece_bb(pt));
-    return phase;
+        attacked_by[WHITE][pt] = attacked_by[BLACK][pt] = 0;
 }
 
+template <Color Us>
 Score Evaluator::eval_pawns()
 {
+    typedef Relative<Us> R;
+    constexpr Color Them = Color(!Us);
+
     Score value;
-    u64 their_pawns_bb = pos.piece_bb(PAWN, THEM);
-    u64 pawn_bb = pos.piece_bb(PAWN, US);
+    u64 their_pawns_bb = pos.piece_bb(PAWN, Them);
+    u64 pawn_bb = pos.piece_bb(PAWN, Us);
 
     // Store blocked pawns
-    this->blocked_pawn_bb[this->side] = ((pawn_bb << 8) & their_pawns_bb) >> 8;
+    this->blocked_pawn_bb[Us] = shift_bb<-R::UP>(shift_bb<R::UP>(pawn_bb) & their_pawns_bb);
 
     // Squares covered by our pawns' attacks
     u64 attacked = 0;
-    attacked |= ((pawn_bb & ~FILE_A_MASK) << 7);
-    attacked |= ((pawn_bb & ~FILE_H_MASK) << 9);
+    attacked |= shift_bb<R::UP_LEFT>(pawn_bb & ~FILE_A_MASK);
+    attacked |= shift_bb<R::UP_RIGHT>(pawn_bb & ~FILE_H_MASK);
 
     // Update pawn attacks
-    this->attacked_by[this->side][PAWN] |= attacked;
-    this->attacked_by[this->side][ALL_PIECES] |= attacked;
-
-    // Material value
-    value += piece_value[PAWN] * popcnt(pawn_bb);
+    this->attacked_by[Us][PAWN] |= attacked;
+    this->attacked_by[Us][ALL_PIECES] |= attacked;
 
     u64 bb = pawn_bb;
     while (bb) {
@@ -100,15 +96,15 @@ Score Evaluator::eval_pawns()
         bb &= bb - 1;
 
         // Piece square value
-        value += psqt[PAWN][sq];
+        value += psqt[PAWN][relative_sq(Us, sq)];
 
         // Doubled pawn
-        if (lookups::north(sq) & pawn_bb)
+        if (lookups::forward_file(Us, sq) & pawn_bb)
             value += doubled_pawns;
 
         // Passed pawn
-        else if (!(lookups::passed_pawn_mask(sq) & their_pawns_bb))
-            this->passed_pawn_bb[this->side] ^= BB(sq);
+        else if (!(lookups::passed_pawn_mask(Us, sq) & their_pawns_bb))
+            this->passed_pawn_bb[Us] ^= BB(sq);
 
         // Isolated Pawn
         if (!(lookups::adjacent_files(sq) & pawn_bb))
@@ -117,53 +113,77 @@ Score Evaluator::eval_pawns()
     return value;
 }
 
+// Pawn evaluation of both sides, from the pawn hash table when possible
+Score Evaluator::eval_pawn_structure()
+{
+    u64 key = pos.get_pawn_key();
+    PawnEntry& entry = this->tables.pawns.probe(key);
+    if (entry.key != key)
+    {
+        entry.key = key;
+        entry.value = eval_pawns<WHITE>() - eval_pawns<BLACK>();
+        for (int c = WHITE; c <= BLACK; ++c) {
+            entry.passed[c] = this->passed_pawn_bb[c];
+            entry.attacks[c] = this->attacked_by[c][PAWN];
+            entry.blocked[c] = this->blocked_pawn_bb[c];
+        }
+        return entry.value;
+    }
+
+    for (int c = WHITE; c <= BLACK; ++c) {
+        this->passed_pawn_bb[c] = entry.passed[c];
+        this->blocked_pawn_bb[c] = entry.blocked[c];
+        this->attacked_by[c][PAWN] = entry.attacks[c];
+        this->attacked_by[c][ALL_PIECES] |= entry.attacks[c];
+    }
+    return entry.value;
+}
+
+template <Color Us>
 Score Evaluator::eval_pieces()
 {
+    typedef Relative<Us> R;
+    typedef Relative<Color(!Us)> RThem;
+    constexpr Color Them = Color(!Us);
+
     Score value;
 
     // Squares which are occupied by our pawns or king or defended by the
     // opponent's pawns
     u64 mobility_mask = 0;
-    mobility_mask |= ((pos.piece_bb(PAWN, THEM) & ~FILE_A_MASK) >> 9);
-    mobility_mask |= ((pos.piece_bb(PAWN, THEM) & ~FILE_H_MASK) >> 7);
-    mobility_mask |= this->blocked_pawn_bb[this->side] | pos.piece_bb(KING, US);
+    mobility_mask |= shift_bb<RThem::UP_LEFT>(pos.piece_bb(PAWN, Them) & ~FILE_A_MASK);
+    mobility_mask |= shift_bb<RThem::UP_RIGHT>(pos.piece_bb(PAWN, Them) & ~FILE_H_MASK);
+    mobility_mask |= this->blocked_pawn_bb[Us] | pos.piece_bb(KING, Us);
     mobility_mask = ~mobility_mask;
 
     u64 occupancy = pos.occupancy_bb();
 
-    // Bishop pair
-    if (popcnt(pos.piece_bb(BISHOP, US)) >= 2)
-        value += bishop_pair;
-
     // Rook on relative 7th rank
-    value += rook_on_7th_rank * popcnt(pos.piece_bb(ROOK, US) & RANK_7_MASK);
+    value += rook_on_7th_rank * popcnt(pos.piece_bb(ROOK, Us) & R::RANK_7);
 
+    u64 their_king_zone = lookups::king_danger_zone(Them, pos.position_of(KING, Them));
     for (int pt = KNIGHT; pt < KING; ++pt) {
-        u64 bb = pos.piece_bb(pt, US);
-
-        // Material value
-        value += piece_value[pt] * popcnt(bb);
-
+        u64 bb = pos.piece_bb(pt, Us);
         while (bb) {
             int sq = fbitscan(bb);
             bb &= bb - 1;
 
             // Piece square value
-            value += psqt[pt][sq];
+            value += psqt[pt][relative_sq(Us, sq)];
 
             // Mobility
             u64 atks_bb = lookups::attacks(pt, sq, occupancy);
             value += piece_mobility[pt][popcnt(atks_bb & mobility_mask)];
 
             // Update attacks
-            this->attacked_by[this->side][pt] |= atks_bb;
-            this->attacked_by[this->side][ALL_PIECES] |= atks_bb;
+            this->attacked_by[Us][pt] |= atks_bb;
+            this->attacked_by[Us][ALL_PIECES] |= atks_bb;
 
             // Attacks to their king
-            u64 king_atks_bb = atks_bb & lookups::king_danger_zone(pos.position_of(KING, THEM));
+            u64 king_atks_bb = atks_bb & their_king_zone;
             if (king_atks_bb)
             {
-                this->king_attacks[this->side] +=
+                this->king_attacks[Us] +=
                     king_attack_weight[pt] * popcnt(king_atks_bb);
             }
         }
@@ -172,43 +192,48 @@ Score Evaluator::eval_pieces()
     return value;
 }
 
+template <Color Us>
 Score Evaluator::eval_king()
 {
     Score value;
 
-    int ksq = pos.position_of(KING, US);
+    int ksq = pos.position_of(KING, Us);
 
     // King shelter
-    u64 pawn_bb = pos.piece_bb(PAWN, US);
-    auto shelter = lookups::king_shelter_masks(ksq);
+    u64 pawn_bb = pos.piece_bb(PAWN, Us);
+    auto shelter = lookups::king_shelter_masks(Us, ksq);
     value += close_shelter * popcnt(pawn_bb & shelter.first);
     value += far_shelter * popcnt(pawn_bb & shelter.second);
 
     // Update attacks
     u64 atks_bb = lookups::king(ksq);
-    this->attacked_by[this->side][KING] |= atks_bb;
-    this->attacked_by[this->side][ALL_PIECES] |= atks_bb;
+    this->attacked_by[Us][KING] |= atks_bb;
+    this->attacked_by[Us][ALL_PIECES] |= atks_bb;
 
     // Piece square value
-    value += psqt[KING][ksq];
+    value += psqt[KING][relative_sq(Us, ksq)];
 
     // Lookup king attack index
-    int val = king_attack_table[std::min(this->king_attacks[this->side], 99)];
+    int val = king_attack_table[std::min(this->king_attacks[Us], 99)];
     value += S(val, val/2);
     return value;
 }
 
+template <Color Us>
 Score Evaluator::eval_passed_pawns()
 {
+    typedef Relative<Us> R;
+    constexpr Color Them = Color(!Us);
+
     Score value;
     u64 occupancy = pos.occupancy_bb();
-    u64 passed_pawn_bb = this->passed_pawn_bb[this->side];
+    u64 passed_pawn_bb = this->passed_pawn_bb[Us];
     while (passed_pawn_bb) {
         int sq = fbitscan(passed_pawn_bb);
         passed_pawn_bb &= passed_pawn_bb - 1;
 
-        int rank = rank_of(sq);
-        u64 forward = BB(sq + 8);
+        int rank = relative_rank(Us, sq);
+        u64 forward = BB(sq + R::UP);
 
         // Passed pawn value
         if (forward & occupancy)
@@ -217,18 +242,18 @@ Score Evaluator::eval_passed_pawns()
         }
         else
         {
-            u64 path_to_queen = lookups::north(sq),
+            u64 path_to_queen = lookups::forward_file(Us, sq),
                 defended = path_to_queen,
                 attacked = path_to_queen;
 
             u64 xrayers = (pos.piece_bb(ROOK) | pos.piece_bb(QUEEN))
-                         & lookups::south(sq)
+                         & lookups::forward_file(Them, sq)
                          & lookups::rook(sq, occupancy);
 
-            if (!(xrayers & pos.color_bb(US)))
-                defended &= attacked_by[this->side][ALL_PIECES];
-            if (!(xrayers & pos.color_bb(THEM)))
-                attacked &= attacked_by[!this->side][ALL_PIECES];
+            if (!(xrayers & pos.color_bb(Us)))
+                defended &= attacked_by[Us][ALL_PIECES];
+            if (!(xrayers & pos.color_bb(Them)))
+                attacked &= attacked_by[Them][ALL_PIECES];
 
             int type;
             if (!attacked)
@@ -244,35 +269,60 @@ Score Evaluator::eval_passed_pawns()
     return value;
 }
 
-int Evaluator::evaluate()
+// Lone king against a rook or queen, from the strong side's point of view.
+// All that matters is driving the weak king to the edge with the strong one
+// close by.
+template <Color Strong>
+int Evaluator::eval_kxk(const MaterialEntry& material)
 {
-    Score score;
-    for (int side = US; side <= THEM; ++side) {
-        this->side = side;
-
-        score += eval_pawns();
-        score += eval_pieces();
+    int weak_ksq = pos.position_of(KING, !Strong);
+    int strong_ksq = pos.position_of(KING, Strong);
+    int file = file_of(weak_ksq),
+        rank = rank_of(weak_ksq);
+    int edge_distance = std::min(std::min(file, 7 - file),
+                                 std::min(rank, 7 - rank));
+
+    int value = material.value.value(0, MAX_PHASE);
+    value = Strong == WHITE ? value : -value;
+    value += 30 * (3 - edge_distance);
+    value += 10 * (7 - lookups::distance(weak_ksq, strong_ksq));
+    return value;
+}
 
-        pos.flip();
-        score = -score;
+int Evaluator::evaluate()
+{
+    const MaterialEntry& material =
+        this->tables.material.probe(pos.get_material_key());
+    if (material.kxk)
+    {
+        int value = material.strong_side == WHITE ? eval_kxk<WHITE>(material)
+                                                  : -eval_kxk<BLACK>(material);
+        return pos.get_side() == WHITE ? value : -value;
     }
 
-    for (int side = US; side <= THEM; ++side) {
-        this->side = side;
+    Score score = material.value;
+    score += eval_pawn_structure();
+    score += eval_pieces<WHITE>() - eval_pieces<BLACK>();
 
-        score += eval_king();
-        score += eval_passed_pawns();
+    // King safety first so that passed pawns see both kings' attacks
+    score += eval_king<WHITE>() - eval_king<BLACK>();
+    score += eval_passed_pawns<WHITE>() - eval_passed_pawns<BLACK>();
 
-        pos.flip();
-        score = -score;
-    }
+    int value = score.value(material.phase, MAX_PHASE);
 
-    int phase = get_game_phase();
-    return score.value(phase, MAX_PHASE);
+    // Scale down the side ahead when it cannot win
+    value = value * material.scale[value < 0] / SCALE_NORMAL;
+    return pos.get_side() == WHITE ? value : -value;
 }
 
-int Position::evaluate()
+int Position::evaluate(EvalTables& tables)
 {
-    Evaluator evaluator(*this);
-    return evaluator.evaluate();
+    int eval;
+    if (tables.evals.probe(this->hash_key, eval))
+        return eval;
+
+    Evaluator evaluator(*this, tables);
+    eval = evaluator.evaluate();
+    tables.evals.store(this->hash_key, eval);
+    return eval;
 }
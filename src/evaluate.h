@@ -25,7 +25,12 @@ SOFTWARE.
 #ifndef EVALUATE_H
 #define EVALUATE_H
 
+#include <array>
+
 #include "score.h"
+#include "pawns.h"
+#include "evalcache.h"
+#include "material.h"
 
 inline int piece_phase[5] = { 1, 10, 10, 20, 40 };
 inline Score piece_value[5] = {
@@ -89,8 +94,8 @@ inline int king_attack_table[100] = { // Taken from CPW(Glaurung 1.2)
     650, 650, 650, 650, 650, 650, 650, 650, 650, 650
 };
 
-inline Score psqt[6][64];
-inline Score psq_tmp[6][64] = {
+// Half tables, mirrored into psqt below
+constexpr Score psq_tmp[6][64] = {
     {   // Pawn
         S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0),
         S(  0,   0), S(  0,   0), S(  0,   0), S(  0,   0),
@@ -155,24 +160,47 @@ inline Score psq_tmp[6][64] = {
     }
 };
 
-namespace eval
+// Full tables, mirrored from the half tables at compile time
+constexpr std::array<std::array<Score, 64>, 6> make_psqt()
 {
-    inline void init()
-    {
-        int k = 0;
-        for (int i = 0; i < 8; ++i) {
-            for (int j = 0;  j < 4; ++j) {
-                int sq1 = get_sq(i, j);
-                int sq2 = get_sq(i, (7 - j));
-                for (int pt = PAWN; pt <= KING; ++pt) {
-                    psqt[pt][sq1]
-                        = psqt[pt][sq2]
-                        = psq_tmp[pt][k];
-                }
-                ++k;
+    std::array<std::array<Score, 64>, 6> table{};
+    int k = 0;
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0;  j < 4; ++j) {
+            int sq1 = get_sq(i, j);
+            int sq2 = get_sq(i, (7 - j));
+            for (int pt = PAWN; pt <= KING; ++pt) {
+                table[pt][sq1]
+                    = table[pt][sq2]
+                    = psq_tmp[pt][k];
             }
+            ++k;
         }
     }
+    return table;
+}
+
+inline constexpr std::array<std::array<Score, 64>, 6> psqt = make_psqt();
+
+// Caches owned by each search thread. They live in the search globals, so
+// they stay warm from one search to the next.
+struct EvalTables
+{
+    void resize(int pawn_mb);
+
+    PawnTable pawns;
+    EvalCache evals;
+    MaterialTable material;
+};
+
+inline void EvalTables::resize(int pawn_mb)
+{
+    if (this->pawns.size_mb() != pawn_mb)
+        this->pawns.resize(pawn_mb);
+    if (!this->evals.allocated())
+        this->evals.allocate();
+    if (!this->material.allocated())
+        this->material.allocate();
 }
 
 #endif
@@ -0,0 +1,79 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef HASH_HISTORY_H
+#define HASH_HISTORY_H
+
+#include <algorithm>
+#include "definitions.h"
+
+// Must be a power of 2 and hold at least the last 100 half-moves plus a full
+// search line
+constexpr int HASH_HISTORY_SIZE = 1024;
+
+// Ring buffer of position keys for repetition detection. Keys of positions
+// played in the game are pushed before the search, keys of positions within
+// the search are set by their ply from the root.
+struct HashHistory
+{
+    HashHistory();
+    void clear();
+    void push(u64 key);
+    void set(int ply, u64 key);
+    bool is_repetition(int ply, u64 key, int half_moves) const;
+
+private:
+    int root;
+    u64 keys[HASH_HISTORY_SIZE];
+};
+
+inline HashHistory::HashHistory() : root(0) {}
+
+inline void HashHistory::clear()
+{
+    root = 0;
+}
+
+inline void HashHistory::push(u64 key)
+{
+    keys[root & (HASH_HISTORY_SIZE - 1)] = key;
+    ++root;
+}
+
+inline void HashHistory::set(int ply, u64 key)
+{
+    keys[(root + ply) & (HASH_HISTORY_SIZE - 1)] = key;
+}
+
+inline bool HashHistory::is_repetition(int ply, u64 key, int half_moves) const
+{
+    int curr = root + ply;
+    int earliest = std::max(0, curr - half_moves);
+    for (int i = curr - 2; i >= earliest; i -= 2)
+        if (keys[i & (HASH_HISTORY_SIZE - 1)] == key)
+            return true;
+    return false;
+}
+
+#endif
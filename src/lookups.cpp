@@ -25,46 +25,58 @@ SOFTWARE.
 #include <iostream>
 #include "definitions.h"
 #include "lookups.h"
-#include "utils.h"
 
-u64 psq_keys_bb[2][6][64];
-u64 castle_keys_bb[16];
-u64 ep_keys_bb[64];
-u64 stm_key_bb;
-
-int distance_val[64][64];
-u64 ray_bb[64][64];
-u64 xray_bb[64][64];
-u64 full_ray_bb[64][64];
-u64 intervening_ray_bb[64][64];
-u64 adjacent_files_bb[64];
-u64 adjacent_sqs_bb[64];
-u64 file_mask_bb[64];
-u64 rank_mask_bb[64];
-
-u64 pawn_attacks[2][64];
-u64 knight_attacks[64];
-u64 bishop_attacks[64];
-u64 rook_attacks[64];
-u64 queen_attacks[64];
-u64 king_attacks[64];
-
-u64 north_bb[64];
-u64 south_bb[64];
-u64 east_bb[64];
-u64 west_bb[64];
-u64 northeast_bb[64];
-u64 northwest_bb[64];
-u64 southeast_bb[64];
-u64 southwest_bb[64];
-u64 north_region_bb[64];
-u64 south_region_bb[64];
-u64 east_region_bb[64];
-u64 west_region_bb[64];
-
-u64 passed_pawn_mask_bb[64];
-u64 king_danger_zone_bb[64];
-u64 king_shelter_mask_bb[64][2];
+static u64 slider_attacks[102400 + 5248];
+
+const u64 rook_magic_numbers[64] = {
+    0x1080004008801020ULL, 0x0840092002c03000ULL, 0x1900200010400900ULL,
+    0x0880100008000480ULL, 0x4200100420080200ULL, 0x8100020100080400ULL,
+    0x0200040110886200ULL, 0x0200008040220411ULL, 0x0404800084400220ULL,
+    0x0000401000402000ULL, 0x0086001081220440ULL, 0x0408800800100280ULL,
+    0x000a001201040820ULL, 0x8848800200840080ULL, 0x4001000100040200ULL,
+    0x0442000102105084ULL, 0x9080010020804100ULL, 0x0040404000201009ULL,
+    0x0000808010002009ULL, 0x2200090021d00100ULL, 0x0008008008040080ULL,
+    0x0004004002010040ULL, 0x0011040008015042ULL, 0x00000a0001768104ULL,
+    0x0000800080204009ULL, 0x2010004140002001ULL, 0x9800200280100080ULL,
+    0x1000100080080080ULL, 0x0442000a00049020ULL, 0x2100040080020080ULL,
+    0x0800120400900148ULL, 0x0010040a00128541ULL, 0x2800804000800030ULL,
+    0x1010002000400041ULL, 0x4000200011004100ULL, 0x0610008410800800ULL,
+    0x0400802402800800ULL, 0xc100020080800400ULL, 0x0002000802000401ULL,
+    0x0182085882000401ULL, 0x0220204000808000ULL, 0x2860100040024022ULL,
+    0x0001002004110040ULL, 0x99101042000a0020ULL, 0x0004080004008080ULL,
+    0x0010040002008080ULL, 0x2012004881020004ULL, 0x8300842444820011ULL,
+    0x0088403882010200ULL, 0x0820400080210100ULL, 0x0110910040a00300ULL,
+    0x0801100280080480ULL, 0x0242009008200600ULL, 0x1002000489500200ULL,
+    0x0040800200010080ULL, 0x0091800041000080ULL, 0x0000209300488001ULL,
+    0x04c1002414824001ULL, 0x020020000b001041ULL, 0x7000100004200901ULL,
+    0x8002002004100802ULL, 0x30010002084c0007ULL, 0x0888221800813004ULL,
+    0x4000002840840112ULL
+};
+
+const u64 bishop_magic_numbers[64] = {
+    0xa010041108003100ULL, 0x006082020a002900ULL, 0x6810010619200000ULL,
+    0x08281a0520000408ULL, 0x0001104001000400ULL, 0x0018901008048400ULL,
+    0x00040a0210245280ULL, 0x000200210808a402ULL, 0x9140048410821200ULL,
+    0x0800091010820041ULL, 0x20504804832202c0ULL, 0x0100091401081000ULL,
+    0x8021011140000012ULL, 0x0810020804450400ULL, 0x208b0542109008a2ULL,
+    0x0080084a08040204ULL, 0x0040e2a80811244cULL, 0x2505022008008108ULL,
+    0x0430220100420040ULL, 0x010a040420220040ULL, 0x1105000290400000ULL,
+    0x0093001200822120ULL, 0x4000a62048043004ULL, 0x280120048a015004ULL,
+    0x006090002a020814ULL, 0x44042000240800d0ULL, 0x01102800040a4400ULL,
+    0x1004080080220040ULL, 0x0001001011004024ULL, 0x0010044000805040ULL,
+    0x0914041200820100ULL, 0x0004821012821480ULL, 0x0024040500c05021ULL,
+    0x0088611002080200ULL, 0x0116080a00040020ULL, 0x4000020080080080ULL,
+    0x2450450140840040ULL, 0x0000880201484100ULL, 0x0222020404020092ULL,
+    0x8081110600002e00ULL, 0x2842101105000801ULL, 0x1100809008001025ULL,
+    0x00020202221c0400ULL, 0x0422014022009020ULL, 0x0210046102100c00ULL,
+    0xc004008082029102ULL, 0x00aa461801101200ULL, 0x0404080080201108ULL,
+    0x020542108c205002ULL, 0x0410544804100100ULL, 0x0040910841100000ULL,
+    0x0400200042021100ULL, 0x00004204850400c0ULL, 0x0200100410a42102ULL,
+    0x1040020801210102ULL, 0x0805040410420000ULL, 0x2884804130100200ULL,
+    0x800c262201242000ULL, 0x1058000194108800ULL, 0x0014221054420204ULL,
+    0x0104000012a02200ULL, 0x0200881003300100ULL, 0x0140400202840100ULL,
+    0x0402020801010201ULL
+};
 
 void print_bb(u64 bb)
 {
@@ -80,370 +92,82 @@ void print_bb(u64 bb)
     std::cout << std::endl;
 }
 
-void init_non_sliders()
+// Slider attacks found by scanning each ray for its first blocker, only used
+// to fill the magic tables
+static u64 scan_attacks(int square, u64 occupancy, bool rook)
 {
-    for (int sq = A1; sq < NUM_SQUARES; ++sq) {
-        king_attacks[sq] = knight_attacks[sq] = 0;
-        pawn_attacks[US][sq] = pawn_attacks[THEM][sq] = 0;
-
-        // Pawn attacks
-        pawn_attacks[US][sq] |= ((sBB(sq + 7) & ~FILE_H_MASK)
-                               | (sBB(sq + 9) & ~FILE_A_MASK))
-                               & ~RANK_1_MASK;
-        pawn_attacks[THEM][sq] |= ((sBB(sq - 7) & ~FILE_A_MASK)
-                                 | (sBB(sq - 9) & ~FILE_H_MASK))
-                                 & ~RANK_8_MASK;
-
-        // Knight attacks
-        knight_attacks[sq] |= sBB(sq + 17) & ~(FILE_A_MASK | RANK_2_MASK | RANK_1_MASK);
-        knight_attacks[sq] |= sBB(sq + 15) & ~(FILE_H_MASK | RANK_2_MASK | RANK_1_MASK);
-        knight_attacks[sq] |= sBB(sq - 17) & ~(FILE_H_MASK | RANK_7_MASK | RANK_8_MASK);
-        knight_attacks[sq] |= sBB(sq - 15) & ~(FILE_A_MASK | RANK_7_MASK | RANK_8_MASK);
-        knight_attacks[sq] |= sBB(sq - 10) & ~(FILE_H_MASK | FILE_G_MASK | RANK_8_MASK);
-        knight_attacks[sq] |= sBB(sq + 6)  & ~(FILE_H_MASK | FILE_G_MASK | RANK_1_MASK);
-        knight_attacks[sq] |= sBB(sq + 10) & ~(FILE_A_MASK | FILE_B_MASK | RANK_1_MASK);
-        knight_attacks[sq] |= sBB(sq - 6)  & ~(FILE_A_MASK | FILE_B_MASK | RANK_8_MASK);
-
-        // King attacks
-        king_attacks[sq] |= sBB(sq + 8) & ~RANK_1_MASK;
-        king_attacks[sq] |= sBB(sq - 8) & ~RANK_8_MASK;
-        king_attacks[sq] |= sBB(sq + 1) & ~FILE_A_MASK;
-        king_attacks[sq] |= sBB(sq - 1) & ~FILE_H_MASK;
-        king_attacks[sq] |= sBB(sq + 9) & ~(FILE_A_MASK | RANK_1_MASK);
-        king_attacks[sq] |= sBB(sq - 9) & ~(FILE_H_MASK | RANK_8_MASK);
-        king_attacks[sq] |= sBB(sq + 7) & ~(FILE_H_MASK | RANK_1_MASK);
-        king_attacks[sq] |= sBB(sq - 7) & ~(FILE_A_MASK | RANK_8_MASK);
+    u64 atk;
+    if (rook)
+    {
+        atk = lookups::rook(square);
+        atk ^= lookups::north(fbitscan((lookups::north(square) & occupancy) | BB(H8)));
+        atk ^= lookups::south(rbitscan((lookups::south(square) & occupancy) | BB(A1)));
+        atk ^= lookups::west(rbitscan((lookups::west(square) & occupancy) | BB(A1)));
+        atk ^= lookups::east(fbitscan((lookups::east(square) & occupancy) | BB(H8)));
     }
-}
-
-void init_pseudo_sliders()
-{
-    for (int sq = A1; sq < NUM_SQUARES; ++sq) {
-        bishop_attacks[sq] = lookups::northeast(sq) | lookups::northwest(sq)
-                           | lookups::southeast(sq) | lookups::southwest(sq);
-        rook_attacks[sq] = lookups::north(sq) | lookups::south(sq)
-                         | lookups::east(sq) | lookups::west(sq);
-        queen_attacks[sq] = rook_attacks[sq] | bishop_attacks[sq];
+    else
+    {
+        atk = lookups::bishop(square);
+        atk ^= lookups::northwest(fbitscan((lookups::northwest(square) & occupancy) | BB(A8)));
+        atk ^= lookups::northeast(fbitscan((lookups::northeast(square) & occupancy) | BB(H8)));
+        atk ^= lookups::southwest(rbitscan((lookups::southwest(square) & occupancy) | BB(A1)));
+        atk ^= lookups::southeast(rbitscan((lookups::southeast(square) & occupancy) | BB(H1)));
     }
+    return atk;
 }
 
-void init_misc()
+static bool fast_pext()
 {
-    int i, j, high, low;
-    for (i = 0; i < 64; i++) {
-        file_mask_bb[i] = lookups::north(i) | lookups::south(i) | BB(i);
-        rank_mask_bb[i] = lookups::east(i) | lookups::west(i) | BB(i);
-        passed_pawn_mask_bb[i] = 0;
-        if (file_of(i) != FILE_A)
-        {
-            passed_pawn_mask_bb[i] |= north_bb[i-1] | north_bb[i];
-            adjacent_files_bb[i] |= BB(i-1) | north_bb[i-1] | south_bb[i-1];
-            adjacent_sqs_bb[i] |= BB(i-1);
-        }
-        if (file_of(i) != FILE_H)
-        {
-            passed_pawn_mask_bb[i] |= north_bb[i+1] | north_bb[i];
-            adjacent_files_bb[i] |= BB(i+1) | north_bb[i+1] | south_bb[i+1];
-            adjacent_sqs_bb[i] |= BB(i+1);
-        }
-        for (j = 0; j < 64; j++) {
-            distance_val[i][j] = std::max(abs(int(rank_of(i)) - int(rank_of(j))),
-                                      abs(int(file_of(i)) - int(file_of(j))));
-            intervening_ray_bb[i][j] = 0;
-            if (i == j)
-                continue;
-            high = j;
-            if (i > j) {
-                high = i;
-                low = j;
-            }
-            else
-                low = i;
-            if (file_of(high) == file_of(low))
-            {
-                full_ray_bb[i][j] =
-                    (lookups::rook(high) & lookups::rook(low)) | BB(i) | BB(j);
-                xray_bb[low][high] = lookups::north(low);
-                xray_bb[high][low] = lookups::south(high);
-                ray_bb[i][j] = BB(high);
-                for (high -= 8; high >= low; high -= 8) {
-                    ray_bb[i][j] |= BB(high);
-                    if (high != low)
-                        intervening_ray_bb[i][j] |= BB(high);
-                }
-            }
-            else if (rank_of(high) == rank_of(low))
-            {
-                full_ray_bb[i][j] =
-                    (lookups::rook(high) & lookups::rook(low)) | BB(i) | BB(j);
-                xray_bb[low][high] = lookups::east(low);
-                xray_bb[high][low] = lookups::west(high);
-                ray_bb[i][j] = BB(high);
-                for (--high; high >= low; high--) {
-                    ray_bb[i][j] |= BB(high);
-                    if (high != low)
-                        intervening_ray_bb[i][j] |= BB(high);
-                }
-            }
-            else if (rank_of(high) - rank_of(low) == file_of(high) - file_of(low))
-            {
-                full_ray_bb[i][j] =
-                    (lookups::bishop(high) & lookups::bishop(low)) | BB(i) | BB(j);
-                xray_bb[low][high] = lookups::northeast(low);
-                xray_bb[high][low] = lookups::southwest(high);
-                ray_bb[i][j] = BB(high);
-                for (high -= 9; high >= low; high -= 9) {
-                    ray_bb[i][j] |= BB(high);
-                    if (high != low)
-                        intervening_ray_bb[i][j] |= BB(high);
-                }
-            }
-            else if (rank_of(high) - rank_of(low) == file_of(low) - file_of(high))
-            {
-                full_ray_bb[i][j] =
-                    (lookups::bishop(high) & lookups::bishop(low)) | BB(i) | BB(j);
-                xray_bb[low][high] = lookups::northwest(low);
-                xray_bb[high][low] = lookups::southeast(high);
-                ray_bb[i][j] = BB(high);
-                for (high -= 7; high >= low; high -= 7) {
-                    ray_bb[i][j] |= BB(high);
-                    if (high != low)
-                        intervening_ray_bb[i][j] |= BB(high);
-                }
-            }
-        }
-    }
+#if defined(__BMI2__)
+    return true;
+#elif defined(HAS_PEXT)
+    // PEXT is microcoded and slower than a multiply before Zen 3
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("bmi2")
+        && !__builtin_cpu_is("znver1")
+        && !__builtin_cpu_is("znver2");
+#else
+    return false;
+#endif
 }
 
-void init_directions()
+static void init_magics(lookups::Magic* magics, const u64* magic_numbers,
+                        u64* table, bool rook)
 {
-    u64 ne, nw, se, sw;
-    u64 n, w, s, e;
-    u64 ne_mask, nw_mask, se_mask, sw_mask;
-    u64 n_mask, w_mask, s_mask, e_mask;
-    nw_mask = ~(RANK_1_MASK | FILE_H_MASK);
-    ne_mask = ~(RANK_1_MASK | FILE_A_MASK);
-    sw_mask = ~(RANK_8_MASK | FILE_H_MASK);
-    se_mask = ~(RANK_8_MASK | FILE_A_MASK);
-    n_mask = ~(RANK_1_MASK);
-    e_mask = ~(FILE_A_MASK);
-    s_mask = ~(RANK_8_MASK);
-    w_mask = ~(FILE_H_MASK);
-
     for (int sq = A1; sq < NUM_SQUARES; ++sq) {
-        u64 sq_bb = BB(sq);
-
-        nw = (sq_bb << 7) & nw_mask;
-        ne = (sq_bb << 9) & ne_mask;
-        sw = (sq_bb >> 9) & sw_mask;
-        se = (sq_bb >> 7) & se_mask;
-        n = (sq_bb << 8) & n_mask;
-        e = (sq_bb << 1) & e_mask;
-        s = (sq_bb >> 8) & s_mask;
-        w = (sq_bb >> 1) & w_mask;
-
-        for (int times = 0; times < 6; ++times) {
-            nw |= (nw << 7) & nw_mask;
-            ne |= (ne << 9) & ne_mask;
-            sw |= (sw >> 9) & sw_mask;
-            se |= (se >> 7) & se_mask;
-            n |= (n << 8) & n_mask;
-            e |= (e << 1) & e_mask;
-            s |= (s >> 8) & s_mask;
-            w |= (w >> 1) & w_mask;
-        }
-
-        north_bb[sq] = n;
-        south_bb[sq] = s;
-        east_bb[sq] = e;
-        west_bb[sq] = w;
-        northeast_bb[sq] = ne;
-        northwest_bb[sq] = nw;
-        southeast_bb[sq] = se;
-        southwest_bb[sq] = sw;
-    }
-}
-
-void init_keys()
-{
-    for (int c = US; c <= THEM; ++c) {
-        for (int pt = PAWN; pt <= KING; ++pt) {
-            for (int sq = A1; sq <= H8; ++sq) {
-                psq_keys_bb[c][pt][sq] = utils::rand_u64(0, UINT64_MAX);
-            }
-        }
-    }
-    for (int sq = A1; sq <= H8; ++sq) {
-        ep_keys_bb[sq] = utils::rand_u64(0, UINT64_MAX);
-    }
-    for (int cr = 0; cr < 16; ++cr) {
-        castle_keys_bb[cr] = utils::rand_u64(0, UINT64_MAX);
-    }
-    stm_key_bb = utils::rand_u64(0, UINT64_MAX);
-}
-
-void init_eval_masks()
-{
-    for (int i = 0; i < 64; ++i) {
-        king_danger_zone_bb[i] =
-              BB(i)
-            | lookups::king(i)
-            | (lookups::king(i) >> 8);
-        if (i < 56)
-        {
-            king_shelter_mask_bb[i][0] = sBB(i + 8)
-                | (lookups::king(i) & (lookups::king(i+8) << 8));
-            if (i < 48)
-                king_shelter_mask_bb[i][1] = king_shelter_mask_bb[i][0] << 8;
-        }
-    }
-}
-
-void init_regions()
-{
-    u64 nr, wr, sr, er;
-    for (int sq = A1; sq <= H8; ++sq) {
-        nr = wr = sr = er = 0ULL;
-        for (int r = rank_of(sq) + 1; r <= RANK_8; ++r)
-            nr |= lookups::rank_mask(get_sq(FILE_A, r));
-        for (int r = rank_of(sq) - 1; r >= RANK_1; --r)
-            sr |= lookups::rank_mask(get_sq(FILE_A, r));
-        for (int f = file_of(sq) + 1; f <= FILE_H; ++f)
-            er |= lookups::file_mask(get_sq(f, RANK_1));
-        for (int f = file_of(sq) - 1; f >= FILE_A; --f)
-            wr |= lookups::file_mask(get_sq(f, RANK_1));
-
-        north_region_bb[sq] = nr;
-        south_region_bb[sq] = sr;
-        east_region_bb[sq] = er;
-        west_region_bb[sq] = wr;
+        // Edge squares never block further movement, except along their edge
+        u64 edges = ((RANK_1_MASK | RANK_8_MASK) & ~lookups::rank_mask(sq))
+                  | ((FILE_A_MASK | FILE_H_MASK) & ~lookups::file_mask(sq));
+        lookups::Magic& m = magics[sq];
+        m.mask = (rook ? lookups::rook(sq) : lookups::bishop(sq)) & ~edges;
+        m.magic = magic_numbers[sq];
+        m.shift = 64 - popcnt(m.mask);
+        m.attacks = table;
+
+        // Walk every subset of the mask with the carry-rippler trick
+        u64 occupancy = 0;
+        do {
+            m.attacks[m.index(occupancy)] = scan_attacks(sq, occupancy, rook);
+            occupancy = (occupancy - m.mask) & m.mask;
+        } while (occupancy);
+        table += BB(popcnt(m.mask));
     }
 }
 
 namespace lookups
 {
-    void init()
-    {
-        init_non_sliders();
-        init_directions();
-        init_pseudo_sliders();
-        init_misc();
-        init_keys();
-        init_eval_masks();
-        init_regions();
-    }
-
-    u64 psq_key(int c, int pt, int sq) { return psq_keys_bb[c][pt][sq]; }
-    u64 castle_key(int rights) { return castle_keys_bb[rights]; }
-    u64 ep_key(int sq) { return ep_keys_bb[sq]; }
-    u64 stm_key() { return stm_key_bb; }
-
-    int distance(int from, int to) { return distance_val[from][to]; }
-    u64 ray(int from, int to) { return ray_bb[from][to]; }
-    u64 xray(int from, int to) { return xray_bb[from][to]; }
-    u64 full_ray(int from, int to) { return full_ray_bb[from][to]; }
-    u64 intervening_sqs(int from, int to) { return intervening_ray_bb[from][to]; }
-    u64 adjacent_files(int sq) { return adjacent_files_bb[sq]; }
-    u64 adjacent_sqs(int sq) { return adjacent_sqs_bb[sq]; }
-    u64 file_mask(int sq) { return file_mask_bb[sq]; }
-    u64 rank_mask(int sq) { return rank_mask_bb[sq]; }
-
-    u64 north(int square) { return north_bb[square]; }
-    u64 south(int square) { return south_bb[square]; }
-    u64 east(int square) { return east_bb[square]; }
-    u64 west(int square) { return west_bb[square]; }
-    u64 northeast(int square) { return northeast_bb[square]; }
-    u64 northwest(int square) { return northwest_bb[square]; }
-    u64 southeast(int square) { return southeast_bb[square]; }
-    u64 southwest(int square) { return southwest_bb[square]; }
-    u64 north_region(int square) { return north_region_bb[square]; }
-    u64 south_region(int square) { return south_region_bb[square]; }
-    u64 east_region(int square) { return east_region_bb[square]; }
-    u64 west_region(int square) { return west_region_bb[square]; }
-
-    u64 pawn(int square, int side) { return pawn_attacks[side][square]; }
-    u64 knight(int square) { return knight_attacks[square]; }
-    u64 bishop(int square) { return bishop_attacks[square]; }
-    u64 rook(int square) { return rook_attacks[square]; }
-    u64 queen(int square) { return queen_attacks[square]; }
-    u64 king(int square) { return king_attacks[square]; }
-
-    u64 bishop(int square, u64 occupancy)
-    {
-        u64 atk = bishop(square);
-        u64 nw_blockers = (northwest(square) & occupancy) | BB(A8);
-        u64 ne_blockers = (northeast(square) & occupancy) | BB(H8);
-        u64 sw_blockers = (southwest(square) & occupancy) | BB(A1);
-        u64 se_blockers = (southeast(square) & occupancy) | BB(H1);
-
-        atk ^= northwest(fbitscan(nw_blockers));
-        atk ^= northeast(fbitscan(ne_blockers));
-        atk ^= southwest(rbitscan(sw_blockers));
-        atk ^= southeast(rbitscan(se_blockers));
-
-        return atk;
-    }
-
-    u64 rook(int square, u64 occupancy)
-    {
-        u64 atk = rook(square);
-        u64 n_blockers = (north(square) & occupancy) | BB(H8);
-        u64 s_blockers = (south(square) & occupancy) | BB(A1);
-        u64 w_blockers = (west(square) & occupancy) | BB(A1);
-        u64 e_blockers = (east(square) & occupancy) | BB(H8);
-
-        atk ^= north(fbitscan(n_blockers));
-        atk ^= south(rbitscan(s_blockers));
-        atk ^= west(rbitscan(w_blockers));
-        atk ^= east(fbitscan(e_blockers));
-
-        return atk;
-    }
-
-    u64 queen(int square, u64 occupancy)
-    {
-        u64 atk = queen(square);
-        u64 nw_blockers = (northwest(square) & occupancy) | BB(A8);
-        u64 ne_blockers = (northeast(square) & occupancy) | BB(H8);
-        u64 sw_blockers = (southwest(square) & occupancy) | BB(A1);
-        u64 se_blockers = (southeast(square) & occupancy) | BB(H1);
-        u64 n_blockers = (north(square) & occupancy) | BB(H8);
-        u64 s_blockers = (south(square) & occupancy) | BB(A1);
-        u64 w_blockers = (west(square) & occupancy) | BB(A1);
-        u64 e_blockers = (east(square) & occupancy) | BB(H8);
+#if !defined(__BMI2__)
+    bool pext_sliders;
+#endif
+    Magic bishop_magics[64];
+    Magic rook_magics[64];
 
-        atk ^= northwest(fbitscan(nw_blockers));
-        atk ^= northeast(fbitscan(ne_blockers));
-        atk ^= southwest(rbitscan(sw_blockers));
-        atk ^= southeast(rbitscan(se_blockers));
-        atk ^= north(fbitscan(n_blockers));
-        atk ^= south(rbitscan(s_blockers));
-        atk ^= west(rbitscan(w_blockers));
-        atk ^= east(fbitscan(e_blockers));
-
-        return atk;
-    }
-
-    u64 attacks(int piece_type, int square, u64 occupancy, int side)
-    {
-        switch (piece_type) {
-        case PAWN: return pawn(square, side);
-        case KNIGHT: return knight(square);
-        case BISHOP: return bishop(square, occupancy);
-        case ROOK: return rook(square, occupancy);
-        case QUEEN: return queen(square, occupancy);
-        case KING: return king(square);
-        default: return -1;
-        }
-    }
-
-    u64 passed_pawn_mask(int square) { return passed_pawn_mask_bb[square]; }
-    u64 king_danger_zone(int square) { return king_danger_zone_bb[square]; }
-    std::pair<u64, u64> king_shelter_masks(int square)
+    void init()
     {
-        return {
-            king_shelter_mask_bb[square][0],
-            king_shelter_mask_bb[square][1]
-        };
+#if !defined(__BMI2__)
+        pext_sliders = fast_pext();
+#endif
+        init_magics(rook_magics, rook_magic_numbers, slider_attacks, true);
+        init_magics(bishop_magics, bishop_magic_numbers, slider_attacks + 102400, false);
     }
 }
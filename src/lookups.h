@@ -25,8 +25,14 @@ SOFTWARE.
 #ifndef LOOKUPS_H
 #define LOOKUPS_H
 
+#include <array>
+
 #include "definitions.h"
 
+#if defined(__BMI2__)
+#include <immintrin.h>
+#endif
+
 #define RANK_1_MASK (u64(0xff))
 #define RANK_2_MASK (u64(0xff00))
 #define RANK_3_MASK (u64(0xff0000))
@@ -45,52 +51,453 @@ SOFTWARE.
 #define FILE_G_MASK (u64(0x4040404040404040))
 #define FILE_H_MASK (u64(0x8080808080808080))
 
+// Pawn directions and ranks as seen from the given side
+template <Color c>
+struct Relative
+{
+    static constexpr int UP = c == WHITE ? 8 : -8;
+    static constexpr int UP_LEFT = c == WHITE ? 7 : -9;
+    static constexpr int UP_RIGHT = c == WHITE ? 9 : -7;
+    static constexpr u64 RANK_3 = c == WHITE ? RANK_3_MASK : RANK_6_MASK;
+    static constexpr u64 RANK_4 = c == WHITE ? RANK_4_MASK : RANK_5_MASK;
+    static constexpr u64 RANK_7 = c == WHITE ? RANK_7_MASK : RANK_2_MASK;
+    static constexpr u64 RANK_8 = c == WHITE ? RANK_8_MASK : RANK_1_MASK;
+};
+
+// Parallel bit extract, either from the compiler intrinsic or, when not built
+// for BMI2, emitted directly so it can be enabled after a runtime CPU check
+#if defined(__BMI2__)
+#define HAS_PEXT
+inline u64 pext(u64 bb, u64 mask) { return _pext_u64(bb, mask); }
+#elif defined(__x86_64__) && defined(__GNUC__)
+#define HAS_PEXT
+inline u64 pext(u64 bb, u64 mask)
+{
+    u64 result;
+    asm("pextq %2, %1, %0" : "=r" (result) : "r" (bb), "r" (mask));
+    return result;
+}
+#endif
+
 namespace lookups
 {
+#if defined(__BMI2__)
+    constexpr bool pext_sliders = true;
+#else
+    extern bool pext_sliders;
+#endif
+
+    // Fancy magic entry for the attacks of one slider on one square
+    struct Magic
+    {
+        u64* attacks;
+        u64 mask;
+        u64 magic;
+        unsigned shift;
+
+        unsigned index(u64 occupancy) const
+        {
+#ifdef HAS_PEXT
+            if (pext_sliders)
+                return pext(occupancy, this->mask);
+#endif
+            return ((occupancy & this->mask) * this->magic) >> this->shift;
+        }
+    };
+
+    extern Magic bishop_magics[64];
+    extern Magic rook_magics[64];
+
+    typedef std::array<u64, 64> SquareTable;
+    typedef std::array<SquareTable, 2> SideTable;
+    typedef std::array<SquareTable, 64> PairTable;
+
+    // Squares reached by sliding from each square along one direction
+    constexpr SquareTable make_direction(int shift, u64 mask)
+    {
+        SquareTable table{};
+        for (int sq = A1; sq < NUM_SQUARES; ++sq) {
+            u64 bb = BB(sq);
+            for (int times = 0; times < 7; ++times) {
+                bb = (shift > 0 ? bb << shift : bb >> -shift) & mask;
+                table[sq] |= bb;
+            }
+        }
+        return table;
+    }
+
+    inline constexpr SquareTable north_bb = make_direction(8, ~RANK_1_MASK);
+    inline constexpr SquareTable south_bb = make_direction(-8, ~RANK_8_MASK);
+    inline constexpr SquareTable east_bb = make_direction(1, ~FILE_A_MASK);
+    inline constexpr SquareTable west_bb = make_direction(-1, ~FILE_H_MASK);
+    inline constexpr SquareTable northeast_bb
+        = make_direction(9, ~(RANK_1_MASK | FILE_A_MASK));
+    inline constexpr SquareTable northwest_bb
+        = make_direction(7, ~(RANK_1_MASK | FILE_H_MASK));
+    inline constexpr SquareTable southeast_bb
+        = make_direction(-7, ~(RANK_8_MASK | FILE_A_MASK));
+    inline constexpr SquareTable southwest_bb
+        = make_direction(-9, ~(RANK_8_MASK | FILE_H_MASK));
+
+    constexpr SideTable make_pawn_attacks()
+    {
+        SideTable table{};
+        for (int sq = A1; sq < NUM_SQUARES; ++sq) {
+            table[WHITE][sq] = ((sBB(sq + 7) & ~FILE_H_MASK)
+                              | (sBB(sq + 9) & ~FILE_A_MASK))
+                              & ~RANK_1_MASK;
+            table[BLACK][sq] = ((sBB(sq - 7) & ~FILE_A_MASK)
+                              | (sBB(sq - 9) & ~FILE_H_MASK))
+                              & ~RANK_8_MASK;
+        }
+        return table;
+    }
+
+    constexpr SquareTable make_knight_attacks()
+    {
+        SquareTable table{};
+        for (int sq = A1; sq < NUM_SQUARES; ++sq) {
+            table[sq] |= sBB(sq + 17) & ~(FILE_A_MASK | RANK_2_MASK | RANK_1_MASK);
+            table[sq] |= sBB(sq + 15) & ~(FILE_H_MASK | RANK_2_MASK | RANK_1_MASK);
+            table[sq] |= sBB(sq - 17) & ~(FILE_H_MASK | RANK_7_MASK | RANK_8_MASK);
+            table[sq] |= sBB(sq - 15) & ~(FILE_A_MASK | RANK_7_MASK | RANK_8_MASK);
+            table[sq] |= sBB(sq - 10) & ~(FILE_H_MASK | FILE_G_MASK | RANK_8_MASK);
+            table[sq] |= sBB(sq + 6)  & ~(FILE_H_MASK | FILE_G_MASK | RANK_1_MASK);
+            table[sq] |= sBB(sq + 10) & ~(FILE_A_MASK | FILE_B_MASK | RANK_1_MASK);
+            table[sq] |= sBB(sq - 6)  & ~(FILE_A_MASK | FILE_B_MASK | RANK_8_MASK);
+        }
+        return table;
+    }
+
+    constexpr SquareTable make_king_attacks()
+    {
+        SquareTable table{};
+        for (int sq = A1; sq < NUM_SQUARES; ++sq) {
+            table[sq] |= sBB(sq + 8) & ~RANK_1_MASK;
+            table[sq] |= sBB(sq - 8) & ~RANK_8_MASK;
+            table[sq] |= sBB(sq + 1) & ~FILE_A_MASK;
+            table[sq] |= sBB(sq - 1) & ~FILE_H_MASK;
+            table[sq] |= sBB(sq + 9) & ~(FILE_A_MASK | RANK_1_MASK);
+            table[sq] |= sBB(sq - 9) & ~(FILE_H_MASK | RANK_8_MASK);
+            table[sq] |= sBB(sq + 7) & ~(FILE_H_MASK | RANK_1_MASK);
+            table[sq] |= sBB(sq - 7) & ~(FILE_A_MASK | RANK_8_MASK);
+        }
+        return table;
+    }
+
+    inline constexpr SideTable pawn_bb = make_pawn_attacks();
+    inline constexpr SquareTable knight_bb = make_knight_attacks();
+    inline constexpr SquareTable king_bb = make_king_attacks();
+
+    constexpr SquareTable make_union(const SquareTable& a, const SquareTable& b,
+                                     const SquareTable& c, const SquareTable& d)
+    {
+        SquareTable table{};
+        for (int sq = A1; sq < NUM_SQUARES; ++sq)
+            table[sq] = a[sq] | b[sq] | c[sq] | d[sq];
+        return table;
+    }
+
+    // Attacks of the sliders on an empty board
+    inline constexpr SquareTable bishop_bb
+        = make_union(northeast_bb, northwest_bb, southeast_bb, southwest_bb);
+    inline constexpr SquareTable rook_bb
+        = make_union(north_bb, south_bb, east_bb, west_bb);
+    inline constexpr SquareTable queen_bb
+        = make_union(bishop_bb, rook_bb, SquareTable{}, SquareTable{});
+
+    struct FileTables
+    {
+        SquareTable file_mask;
+        SquareTable rank_mask;
+        SquareTable adjacent_files;
+        SquareTable adjacent_sqs;
+        SideTable passed_pawn_mask;
+    };
+
+    constexpr FileTables make_file_tables()
+    {
+        FileTables t{};
+        for (int i = 0; i < 64; ++i) {
+            t.file_mask[i] = north_bb[i] | south_bb[i] | BB(i);
+            t.rank_mask[i] = east_bb[i] | west_bb[i] | BB(i);
+            t.passed_pawn_mask[WHITE][i] = north_bb[i];
+            if (file_of(i) != FILE_A)
+            {
+                t.passed_pawn_mask[WHITE][i] |= north_bb[i-1];
+                t.adjacent_files[i] |= BB(i-1) | north_bb[i-1] | south_bb[i-1];
+                t.adjacent_sqs[i] |= BB(i-1);
+            }
+            if (file_of(i) != FILE_H)
+            {
+                t.passed_pawn_mask[WHITE][i] |= north_bb[i+1];
+                t.adjacent_files[i] |= BB(i+1) | north_bb[i+1] | south_bb[i+1];
+                t.adjacent_sqs[i] |= BB(i+1);
+            }
+        }
+
+        // Black masks are the white masks mirrored vertically
+        for (int i = 0; i < 64; ++i)
+            t.passed_pawn_mask[BLACK][i]
+                = __builtin_bswap64(t.passed_pawn_mask[WHITE][i ^ 56]);
+        return t;
+    }
+
+    inline constexpr FileTables file_tables = make_file_tables();
+
+    struct LineTables
+    {
+        std::array<std::array<int, 64>, 64> distance;
+        PairTable ray;
+        PairTable xray;
+        PairTable full_ray;
+        PairTable intervening;
+    };
+
+    constexpr LineTables make_line_tables()
+    {
+        LineTables t{};
+        for (int i = 0; i < 64; ++i) {
+            for (int j = 0; j < 64; ++j) {
+                int rank_diff = rank_of(i) - rank_of(j);
+                int file_diff = file_of(i) - file_of(j);
+                rank_diff = rank_diff < 0 ? -rank_diff : rank_diff;
+                file_diff = file_diff < 0 ? -file_diff : file_diff;
+                t.distance[i][j] = rank_diff > file_diff ? rank_diff : file_diff;
+                if (i == j)
+                    continue;
+
+                int high = i > j ? i : j;
+                int low = i > j ? j : i;
+                int step = 0;
+                if (file_of(high) == file_of(low))
+                {
+                    t.full_ray[i][j] = rook_bb[high] & rook_bb[low];
+                    t.xray[low][high] = north_bb[low];
+                    t.xray[high][low] = south_bb[high];
+                    step = 8;
+                }
+                else if (rank_of(high) == rank_of(low))
+                {
+                    t.full_ray[i][j] = rook_bb[high] & rook_bb[low];
+                    t.xray[low][high] = east_bb[low];
+                    t.xray[high][low] = west_bb[high];
+                    step = 1;
+                }
+                else if (rank_of(high) - rank_of(low) == file_of(high) - file_of(low))
+                {
+                    t.full_ray[i][j] = bishop_bb[high] & bishop_bb[low];
+                    t.xray[low][high] = northeast_bb[low];
+                    t.xray[high][low] = southwest_bb[high];
+                    step = 9;
+                }
+                else if (rank_of(high) - rank_of(low) == file_of(low) - file_of(high))
+                {
+                    t.full_ray[i][j] = bishop_bb[high] & bishop_bb[low];
+                    t.xray[low][high] = northwest_bb[low];
+                    t.xray[high][low] = southeast_bb[high];
+                    step = 7;
+                }
+                if (!step)
+                    continue;
+
+                t.full_ray[i][j] |= BB(i) | BB(j);
+                t.ray[i][j] = BB(high);
+                for (high -= step; high >= low; high -= step) {
+                    t.ray[i][j] |= BB(high);
+                    if (high != low)
+                        t.intervening[i][j] |= BB(high);
+                }
+            }
+        }
+        return t;
+    }
+
+    inline constexpr LineTables line_tables = make_line_tables();
+
+    struct RegionTables
+    {
+        SquareTable north;
+        SquareTable south;
+        SquareTable east;
+        SquareTable west;
+    };
+
+    constexpr RegionTables make_region_tables()
+    {
+        RegionTables t{};
+        for (int sq = A1; sq <= H8; ++sq) {
+            for (int r = rank_of(sq) + 1; r <= RANK_8; ++r)
+                t.north[sq] |= file_tables.rank_mask[get_sq(FILE_A, r)];
+            for (int r = rank_of(sq) - 1; r >= RANK_1; --r)
+                t.south[sq] |= file_tables.rank_mask[get_sq(FILE_A, r)];
+            for (int f = file_of(sq) + 1; f <= FILE_H; ++f)
+                t.east[sq] |= file_tables.file_mask[get_sq(f, RANK_1)];
+            for (int f = file_of(sq) - 1; f >= FILE_A; --f)
+                t.west[sq] |= file_tables.file_mask[get_sq(f, RANK_1)];
+        }
+        return t;
+    }
+
+    inline constexpr RegionTables region_tables = make_region_tables();
+
+    struct KingTables
+    {
+        SideTable danger_zone;
+        std::array<SideTable, 2> shelter;
+    };
+
+    constexpr KingTables make_king_tables()
+    {
+        KingTables t{};
+        for (int i = 0; i < 64; ++i) {
+            t.danger_zone[WHITE][i] = BB(i) | king_bb[i] | (king_bb[i] << 8);
+            t.danger_zone[BLACK][i] = BB(i) | king_bb[i] | (king_bb[i] >> 8);
+            if (i < 56)
+            {
+                t.shelter[WHITE][0][i] = sBB(i + 8)
+                    | (king_bb[i] & (king_bb[i+8] << 8));
+                if (i < 48)
+                    t.shelter[WHITE][1][i] = t.shelter[WHITE][0][i] << 8;
+            }
+        }
+
+        // Black masks are the white masks mirrored vertically
+        for (int i = 0; i < 64; ++i) {
+            t.shelter[BLACK][0][i] = __builtin_bswap64(t.shelter[WHITE][0][i ^ 56]);
+            t.shelter[BLACK][1][i] = __builtin_bswap64(t.shelter[WHITE][1][i ^ 56]);
+        }
+        return t;
+    }
+
+    inline constexpr KingTables king_tables = make_king_tables();
+
+    // xorshift64* generator for the Zobrist keys, usable at compile time
+    struct KeyGenerator
+    {
+        u64 state;
+
+        constexpr u64 next()
+        {
+            this->state ^= this->state >> 12;
+            this->state ^= this->state << 25;
+            this->state ^= this->state >> 27;
+            return this->state * 2685821657736338717ULL;
+        }
+    };
+
+    struct ZobristKeys
+    {
+        std::array<std::array<SquareTable, 6>, 2> psq;
+        std::array<u64, 16> castle;
+        SquareTable ep;
+        u64 stm;
+    };
+
+    constexpr ZobristKeys make_zobrist_keys()
+    {
+        ZobristKeys keys{};
+        KeyGenerator gen{88349201835};
+        for (int c = WHITE; c <= BLACK; ++c)
+            for (int pt = PAWN; pt <= KING; ++pt)
+                for (int sq = A1; sq <= H8; ++sq)
+                    keys.psq[c][pt][sq] = gen.next();
+        for (int sq = A1; sq <= H8; ++sq)
+            keys.ep[sq] = gen.next();
+        for (int cr = 0; cr < 16; ++cr)
+            keys.castle[cr] = gen.next();
+        keys.stm = gen.next();
+        return keys;
+    }
+
+    inline constexpr ZobristKeys zobrist_keys = make_zobrist_keys();
+
     extern void init();
 
-    extern u64 psq_key(int c, int pt, int sq);
-    extern u64 castle_key(int rights);
-    extern u64 ep_key(int sq);
-    extern u64 stm_key();
-
-    extern int distance(int from, int to);
-    extern u64 ray(int from, int to);
-    extern u64 xray(int from, int to);
-    extern u64 full_ray(int from, int to);
-    extern u64 intervening_sqs(int from, int to);
-    extern u64 adjacent_files(int square);
-    extern u64 adjacent_sqs(int square);
-    extern u64 file_mask(int square);
-    extern u64 rank_mask(int square);
-
-    extern u64 north(int square);
-    extern u64 south(int square);
-    extern u64 east(int square);
-    extern u64 west(int square);
-    extern u64 northeast(int square);
-    extern u64 northwest(int square);
-    extern u64 southeast(int square);
-    extern u64 southwest(int square);
-    extern u64 north_region(int square);
-    extern u64 south_region(int square);
-    extern u64 east_region(int square);
-    extern u64 west_region(int square);
-
-    extern u64 pawn(int square, int side);
-    extern u64 knight(int square);
-    extern u64 bishop(int square);
-    extern u64 rook(int square);
-    extern u64 queen(int square);
-    extern u64 bishop(int square, u64 occupancy);
-    extern u64 rook(int square, u64 occupancy);
-    extern u64 queen(int square, u64 occupancy);
-    extern u64 king(int square);
-    extern u64 attacks(int piece_type, int square, u64 occupancy, int side=US);
-
-    extern u64 passed_pawn_mask(int square);
-    extern u64 king_danger_zone(int square);
-    extern std::pair<u64, u64> king_shelter_masks(int square);
+    constexpr u64 psq_key(int c, int pt, int sq) { return zobrist_keys.psq[c][pt][sq]; }
+    constexpr u64 castle_key(int rights) { return zobrist_keys.castle[rights]; }
+    constexpr u64 ep_key(int sq) { return zobrist_keys.ep[sq]; }
+    constexpr u64 stm_key() { return zobrist_keys.stm; }
+
+    constexpr int distance(int from, int to) { return line_tables.distance[from][to]; }
+    constexpr u64 ray(int from, int to) { return line_tables.ray[from][to]; }
+    constexpr u64 xray(int from, int to) { return line_tables.xray[from][to]; }
+    constexpr u64 full_ray(int from, int to) { return line_tables.full_ray[from][to]; }
+    constexpr u64 intervening_sqs(int from, int to) { return line_tables.intervening[from][to]; }
+    constexpr u64 adjacent_files(int sq) { return file_tables.adjacent_files[sq]; }
+    constexpr u64 adjacent_sqs(int sq) { return file_tables.adjacent_sqs[sq]; }
+    constexpr u64 file_mask(int sq) { return file_tables.file_mask[sq]; }
+    constexpr u64 rank_mask(int sq) { return file_tables.rank_mask[sq]; }
+
+    constexpr u64 north(int square) { return north_bb[square]; }
+    constexpr u64 south(int square) { return south_bb[square]; }
+    constexpr u64 east(int square) { return east_bb[square]; }
+    constexpr u64 west(int square) { return west_bb[square]; }
+    constexpr u64 northeast(int square) { return northeast_bb[square]; }
+    constexpr u64 northwest(int square) { return northwest_bb[square]; }
+    constexpr u64 southeast(int square) { return southeast_bb[square]; }
+    constexpr u64 southwest(int square) { return southwest_bb[square]; }
+    constexpr u64 north_region(int square) { return region_tables.north[square]; }
+    constexpr u64 south_region(int square) { return region_tables.south[square]; }
+    constexpr u64 east_region(int square) { return region_tables.east[square]; }
+    constexpr u64 west_region(int square) { return region_tables.west[square]; }
+    constexpr u64 forward_file(int side, int square)
+    {
+        return side == WHITE ? north_bb[square] : south_bb[square];
+    }
+
+    constexpr u64 pawn(int square, int side) { return pawn_bb[side][square]; }
+    constexpr u64 knight(int square) { return knight_bb[square]; }
+    constexpr u64 bishop(int square) { return bishop_bb[square]; }
+    constexpr u64 rook(int square) { return rook_bb[square]; }
+    constexpr u64 queen(int square) { return queen_bb[square]; }
+    constexpr u64 king(int square) { return king_bb[square]; }
+
+    inline u64 bishop(int square, u64 occupancy)
+    {
+        const Magic& m = bishop_magics[square];
+        return m.attacks[m.index(occupancy)];
+    }
+
+    inline u64 rook(int square, u64 occupancy)
+    {
+        const Magic& m = rook_magics[square];
+        return m.attacks[m.index(occupancy)];
+    }
+
+    inline u64 queen(int square, u64 occupancy)
+    {
+        return bishop(square, occupancy) | rook(square, occupancy);
+    }
+
+    inline u64 attacks(int piece_type, int square, u64 occupancy, int side=WHITE)
+    {
+        switch (piece_type) {
+        case PAWN: return pawn(square, side);
+        case KNIGHT: return knight(square);
+        case BISHOP: return bishop(square, occupancy);
+        case ROOK: return rook(square, occupancy);
+        case QUEEN: return queen(square, occupancy);
+        case KING: return king(square);
+        default: return -1;
+        }
+    }
+
+    constexpr u64 passed_pawn_mask(int side, int square)
+    {
+        return file_tables.passed_pawn_mask[side][square];
+    }
+    constexpr u64 king_danger_zone(int side, int square)
+    {
+        return king_tables.danger_zone[side][square];
+    }
+    constexpr std::pair<u64, u64> king_shelter_masks(int side, int square)
+    {
+        return {
+            king_tables.shelter[side][0][square],
+            king_tables.shelter[side][1][square]
+        };
+    }
 }
 
 #endif
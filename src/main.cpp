@@ -27,14 +27,12 @@ SOFTWARE.
 
 #include "uci.h"
 #include "lookups.h"
-#include "evaluate.h"
 
 int main()
 {
     std::ios_base::sync_with_stdio(false);
     std::cout.setf(std::ios::unitbuf);
     lookups::init();
-    eval::init();
 
     std::string word;
     while (true) {
@@ -0,0 +1,81 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "material.h"
+#include "evaluate.h"
+
+void MaterialTable::allocate()
+{
+    this->entries = std::make_unique<MaterialEntry[]>(SIZE);
+    // No position has fifteen pawns of a color, so no key matches yet
+    for (u64 i = 0; i < SIZE; ++i)
+        this->entries[i].key = ~u64(0);
+}
+
+namespace material
+{
+    void compute(u64 key, MaterialEntry& entry)
+    {
+        entry.key = key;
+        entry.value = Score();
+        entry.phase = 0;
+        entry.kxk = false;
+        entry.strong_side = WHITE;
+
+        for (int c = WHITE; c <= BLACK; ++c) {
+            Score value;
+            for (int pt = PAWN; pt < KING; ++pt) {
+                value += piece_value[pt] * count(key, c, pt);
+                entry.phase += piece_phase[pt] * count(key, c, pt);
+            }
+            if (count(key, c, BISHOP) >= 2)
+                value += bishop_pair;
+            entry.value += c == WHITE ? value : -value;
+        }
+
+        for (int c = WHITE; c <= BLACK; ++c) {
+            int them = !c;
+            int minors = count(key, c, KNIGHT) + count(key, c, BISHOP);
+            int majors = count(key, c, ROOK) + count(key, c, QUEEN);
+            bool pawns = count(key, c, PAWN);
+
+            // Without pawns a single minor piece or two knights cannot force
+            // a win
+            entry.scale[c] = SCALE_NORMAL;
+            if (   !pawns && !majors
+                && (minors <= 1 || (minors == 2 && count(key, c, KNIGHT) == 2)))
+            {
+                entry.scale[c] = 0;
+            }
+
+            // Their lone king only has to be driven to the edge
+            if (   !pawns && majors
+                && !(key & side_mask(them)))
+            {
+                entry.kxk = true;
+                entry.strong_side = c;
+            }
+        }
+    }
+}
@@ -0,0 +1,87 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef MATERIAL_H
+#define MATERIAL_H
+
+#include <memory>
+
+#include "definitions.h"
+#include "score.h"
+
+// Everything the evaluation derives from the piece counts alone
+struct MaterialEntry
+{
+    u64 key;
+    // Material and bishop pair from white's point of view
+    Score value;
+    int phase;
+    // Out of SCALE_NORMAL, applied when the given side is ahead
+    int scale[2];
+    // Lone king against a rook or queen, evaluated by eval_kxk
+    bool kxk;
+    int strong_side;
+};
+
+constexpr int SCALE_NORMAL = 64;
+
+// Material entries by material key, one table per search thread. Only a
+// handful of material configurations show up in a search, so the table is
+// small. It is allocated on the first search using the thread.
+class MaterialTable
+{
+public:
+    void allocate();
+    bool allocated() const;
+    const MaterialEntry& probe(u64 key);
+
+private:
+    static constexpr u64 SIZE = 1 << 13;
+
+    std::unique_ptr<MaterialEntry[]> entries;
+};
+
+namespace material
+{
+    // The material key packs the count of every piece type but the king into
+    // four bits per color and type, so it changes by one unit per piece
+    constexpr u64 unit(int c, int pt) { return u64(1) << (4 * (5 * c + pt)); }
+    constexpr int count(u64 key, int c, int pt) { return (key >> (4 * (5 * c + pt))) & 0xf; }
+    constexpr u64 side_mask(int c) { return u64(0xfffff) << (20 * c); }
+
+    extern void compute(u64 key, MaterialEntry& entry);
+}
+
+inline bool MaterialTable::allocated() const { return bool(this->entries); }
+
+inline const MaterialEntry& MaterialTable::probe(u64 key)
+{
+    // Spread the packed counts over the table
+    MaterialEntry& entry = this->entries[(key * 0x9e3779b97f4a7c15) >> 51];
+    if (entry.key != key)
+        material::compute(key, entry);
+    return entry;
+}
+
+#endif
@@ -30,6 +30,13 @@ SOFTWARE.
 #include "options.h"
 #include "controller.h"
 
+void Node::generate_moves()
+{
+    MoveList legal_moves;
+    pos.generate_legal_movelist(legal_moves);
+    mlist.assign(legal_moves.begin(), legal_moves.end());
+}
+
 Move Node::next_move()
 {
     Move m = mlist.back();
@@ -93,14 +100,14 @@ Node* Node::get_child()
     return &children[best_index];
 }
 
-int Node::simulate()
+int Node::simulate(HashHistory& history, int ply)
 {
     Position pos = this->pos;
 
-    std::vector<Move> local_mlist;
-    local_mlist.reserve(256);
-    while (true) {
-        if (pos.is_drawn())
+    MoveList local_mlist;
+    for (;; ++ply) {
+        history.set(ply, pos.get_hash_key());
+        if (pos.is_drawn(history, ply))
             return DRAW;
 
         // Generate moves for position
@@ -116,13 +123,13 @@ int Node::simulate()
     }
 
     int result;
-    if (!pos.checkers_to(US))
+    if (!pos.checkers())
     {
         result = DRAW;
     }
     else
     {
-        if (this->get_position().is_flipped() != pos.is_flipped())
+        if (this->get_position().get_side() != pos.get_side())
             result = LOSS;
         else
             result = WIN;
@@ -178,13 +185,16 @@ void GameTree::search()
 {
     time_ms start_time = utils::curr_time();
     time_ms prev_print_time = start_time;
-    bool root_flipped = root.get_position().is_flipped();
 
     while (!stopped()) {
         auto selection = select();
         auto& [curr, parents] = selection;
 
-        int result = curr->simulate();
+        // Keys of the selected line, the rollout continues from its end
+        for (std::size_t ply = 0; ply < parents.size(); ++ply)
+            history.set(ply, parents[ply]->get_position().get_hash_key());
+
+        int result = curr->simulate(history, parents.size());
         if (result == WIN)
             curr->inc_wins();
         curr->inc_simulations();
@@ -200,12 +210,12 @@ void GameTree::search()
                 << " nodes " << root.get_simulations()
                 << " time " << now - start_time
                 << " nps " << root.get_simulations() * 1000 / (now - start_time)
-                << " pv " << uci::get_pv_string(pv, root_flipped)
+                << " pv " << uci::get_pv_string(pv)
                 << std::endl;
             prev_print_time = now;
         }
     }
 
     Move best_move = root.get_child<VALUE>()->get_move();
-    std::cout << "bestmove " << get_move_string(best_move, root_flipped) << std::endl;
+    std::cout << "bestmove " << get_move_string(best_move) << std::endl;
 }
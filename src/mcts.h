@@ -51,10 +51,9 @@ public:
     void inc_wins() { ++wins; }
     void display() { pos.display(); }
     Position& get_position() { return pos; }
-    void generate_moves() { pos.generate_legal_movelist(mlist); }
+    void generate_moves();
     std::vector<Move> get_mlist() { return mlist; }
     Node* latest_child() { return &children.back(); }
-    bool flipped() { return pos.is_flipped(); }
 
     bool is_terminal();
     bool expanded();
@@ -66,12 +65,13 @@ public:
     template <Policy policy>
     Node* get_child();
 
-    int simulate();
+    int simulate(HashHistory& history, int ply);
 
 private:
     Move next_move();
 
     Position pos;
+    // Untried moves, kept as a vector so tree nodes stay small
     std::vector<Move> mlist;
     std::vector<Node> children;
     u64 simulations;
@@ -82,13 +82,15 @@ private:
 class GameTree
 {
 public:
-    GameTree(Position& pos) : root(pos) {}
+    GameTree(Position& pos, const HashHistory& history)
+        : root(pos), history(history) {}
     std::pair<Node*, std::vector<Node*>> select();
     std::vector<Move> pv();
     void search();
 
 private:
     Node root;
+    HashHistory history;
 };
 
 #endif
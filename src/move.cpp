@@ -25,28 +25,21 @@ SOFTWARE.
 #include "position.h"
 #include "move.h"
 
-std::string get_move_string(Move move, bool flipped)
+std::string get_move_string(Move move)
 {
     int from = from_sq(move),
         to = to_sq(move);
 
-    if (flipped)
-    {
-        from ^= 56;
-        to ^= 56;
-    }
-
     std::string move_string;
     move_string.push_back('a' + file_of(from));
     move_string.push_back('1' + rank_of(from));
 
     if (castling::is_frc && (move & CASTLING))
     {
-        int qs_sq = flipped ? C8 : C1;
-        to = to == qs_sq ? castling::rook_sqs[QUEENSIDE]
-                         : castling::rook_sqs[KINGSIDE];
-        if (flipped)
-            to ^= 56;
+        int side = rank_of(to) == RANK_8 ? BLACK : WHITE;
+        to = relative_sq(side, to) == C1 ? castling::rook_sqs[QUEENSIDE]
+                                         : castling::rook_sqs[KINGSIDE];
+        to = relative_sq(side, to);
     }
 
     move_string.push_back('a' + file_of(to));
@@ -74,45 +67,86 @@ std::string get_move_string(Move move, bool flipped)
 
 bool Position::legal_move(Move move) const
 {
+    int us = this->side;
     int from = from_sq(move);
-    int ksq = this->position_of(KING, US);
+    int ksq = this->position_of(KING, us);
     if (move & ENPASSANT)
     {
         u64 to_bb = BB(this->ep_sq);
-        u64 cap_bb = to_bb >> 8;
+        u64 cap_bb = us == WHITE ? to_bb >> 8 : to_bb << 8;
         u64 pieces = (this->occupancy_bb() ^ BB(from) ^ cap_bb) | to_bb;
 
         u64 qr_bb = this->piece_bb(QUEEN) | this->piece_bb(ROOK);
         u64 qb_bb = this->piece_bb(QUEEN) | this->piece_bb(BISHOP);
-        u64 them_bb = this->color_bb(THEM);
+        u64 them_bb = this->color_bb(!us);
 
         return !(lookups::rook(ksq, pieces) & (qr_bb & them_bb))
             && !(lookups::bishop(ksq, pieces) & (qb_bb & them_bb));
     }
     else if (from == ksq)
     {
-        return (move & CASTLING) || !(this->attackers_to(to_sq(move), THEM));
+        // The king must not shield the destination from a slider
+        return (move & CASTLING)
+            || !(this->attackers_to(to_sq(move), !us, this->occupancy_bb() ^ BB(ksq)));
     }
     else
     {
-        return !(this->pinned(US) & BB(from))
+        return !(this->pinned(us) & BB(from))
              || (BB(to_sq(move)) & lookups::full_ray(from, ksq));
     }
 }
 
-void Position::make_null_move()
+static inline void castling_rook_sqs(int side, int to, int& rfrom, int& rto)
+{
+    switch (relative_sq(side, to)) {
+    case C1:
+        rto = relative_sq(side, D1);
+        rfrom = relative_sq(side, castling::rook_sqs[QUEENSIDE]);
+        break;
+    case G1:
+        rto = relative_sq(side, F1);
+        rfrom = relative_sq(side, castling::rook_sqs[KINGSIDE]);
+        break;
+    default:
+        rto = rfrom = -1;
+        break;
+    }
+}
+
+void Position::make_null_move(UndoInfo& undo)
 {
+    this->save(undo);
     this->inc_half_moves();
+    this->hash_key ^= this->ep_key() ^ lookups::stm_key();
     this->ep_sq = INVALID_SQ;
-    this->flip();
-    this->prev_hash_keys.push_back(this->hash_key);
-    this->hash_key = this->calc_hash();
+    this->side = !this->side;
+    assert(this->hash_key == this->calc_hash());
 }
 
-void Position::make_move(Move move)
+void Position::unmake_null_move(const UndoInfo& undo)
+{
+    this->side = !this->side;
+    this->restore(undo);
+}
+
+void Position::make_move(Move move, UndoInfo& undo)
 {
     int from = from_sq(move),
         to = to_sq(move);
+    int us = this->side,
+        them = !us;
+    int down = us == WHITE ? -8 : 8;
+
+    this->save(undo);
+
+    if (this->check_piece_on(from, PAWN))
+        this->reset_half_moves();
+    else
+        this->inc_half_moves();
+
+    // Remove the castling and enpassant keys, they are put back after the
+    // position is updated
+    this->hash_key ^= this->castle_key() ^ this->ep_key();
 
     this->castling_rights &= castling::spoilers[from]
                            & castling::spoilers[to];
@@ -120,69 +154,154 @@ void Position::make_move(Move move)
     if (this->ep_sq != INVALID_SQ)
         this->ep_sq = INVALID_SQ;
 
-    if (this->check_piece_on(from, PAWN))
-    {
-        this->reset_half_moves();
-        this->clear_prev_hash_keys();
-    }
-    else
-    {
-        this->prev_hash_keys.push_back(this->hash_key);
-        this->inc_half_moves();
+    switch (move & MOVE_TYPE_MASK) {
+        case NORMAL:
+            this->move_piece(from, to, this->piece_on(from), us);
+            break;
+        case CAPTURE:
+            undo.captured = this->piece_on(to);
+            this->remove_piece(to, undo.captured, them);
+            this->move_piece(from, to, this->piece_on(from), us);
+            this->reset_half_moves();
+            break;
+        case DOUBLE_PUSH:
+            this->move_piece(from, to, PAWN, us);
+            this->ep_sq = to + down;
+            break;
+        case ENPASSANT:
+            this->move_piece(from, to, PAWN, us);
+            this->remove_piece(to + down, PAWN, them);
+            break;
+        case CASTLING:
+            int rfrom, rto;
+            castling_rook_sqs(us, to, rfrom, rto);
+            this->remove_piece(rfrom, ROOK, us);
+            this->remove_piece(from, KING, us);
+            this->put_piece(rto, ROOK, us);
+            this->put_piece(to, KING, us);
+            break;
+        case PROM_CAPTURE:
+            undo.captured = this->piece_on(to);
+            this->remove_piece(to, undo.captured, them);
+            this->remove_piece(from, PAWN, us);
+            this->put_piece(to, prom_type(move), us);
+            break;
+        case PROMOTION:
+            this->remove_piece(from, PAWN, us);
+            this->put_piece(to, prom_type(move), us);
+            break;
+        default:
+            std::cout << "MOVE TYPE ERROR!" << std::endl;
+            break;
     }
 
+    this->side = them;
+    this->hash_key ^= this->castle_key() ^ this->ep_key() ^ lookups::stm_key();
+    assert(this->hash_key == this->calc_hash());
+    assert(this->pawn_key == this->calc_pawn_key());
+    assert(this->material_key == this->calc_material_key());
+    assert(this->is_consistent());
+}
+
+// Hash key of the position after the move, without making it, so that the
+// tt cluster of the child can be prefetched early
+u64 Position::key_after(Move move) const
+{
+    int from = from_sq(move),
+        to = to_sq(move);
+    int us = this->side,
+        them = !us;
+    int down = us == WHITE ? -8 : 8;
+    int pt = this->piece_on(from);
+    int rights = this->castling_rights & castling::spoilers[from]
+                                       & castling::spoilers[to];
+
+    u64 key = this->hash_key ^ this->castle_key() ^ this->ep_key()
+            ^ lookups::castle_key(rights) ^ lookups::stm_key();
+
     switch (move & MOVE_TYPE_MASK) {
         case NORMAL:
-            this->move_piece(from, to, this->piece_on(from), US);
+            key ^= lookups::psq_key(us, pt, from) ^ lookups::psq_key(us, pt, to);
             break;
         case CAPTURE:
-            this->remove_piece(to, this->piece_on(to), THEM);
-            this->move_piece(from, to, this->piece_on(from), US);
-            this->reset_half_moves();
-            this->clear_prev_hash_keys();
+            key ^= lookups::psq_key(them, this->piece_on(to), to);
+            key ^= lookups::psq_key(us, pt, from) ^ lookups::psq_key(us, pt, to);
+            break;
+        case DOUBLE_PUSH:
+            key ^= lookups::psq_key(us, PAWN, from) ^ lookups::psq_key(us, PAWN, to);
+            key ^= lookups::ep_key(to + down);
+            break;
+        case ENPASSANT:
+            key ^= lookups::psq_key(us, PAWN, from) ^ lookups::psq_key(us, PAWN, to);
+            key ^= lookups::psq_key(them, PAWN, to + down);
+            break;
+        case CASTLING:
+            int rfrom, rto;
+            castling_rook_sqs(us, to, rfrom, rto);
+            key ^= lookups::psq_key(us, ROOK, rfrom) ^ lookups::psq_key(us, ROOK, rto);
+            key ^= lookups::psq_key(us, KING, from) ^ lookups::psq_key(us, KING, to);
+            break;
+        case PROM_CAPTURE:
+            key ^= lookups::psq_key(them, this->piece_on(to), to);
+            key ^= lookups::psq_key(us, PAWN, from) ^ lookups::psq_key(us, prom_type(move), to);
+            break;
+        case PROMOTION:
+            key ^= lookups::psq_key(us, PAWN, from) ^ lookups::psq_key(us, prom_type(move), to);
+            break;
+        default:
             break;
+    }
+    return key;
+}
+
+void Position::unmake_move(Move move, const UndoInfo& undo)
+{
+    int from = from_sq(move),
+        to = to_sq(move);
+    int them = this->side,
+        us = !them;
+    int down = us == WHITE ? -8 : 8;
+
+    this->side = us;
+
+    switch (move & MOVE_TYPE_MASK) {
+        case NORMAL:
         case DOUBLE_PUSH:
-            this->move_piece(from, to, PAWN, US);
-            this->ep_sq = from + 8;
+            this->move_piece(to, from, this->piece_on(to), us);
+            break;
+        case CAPTURE:
+            this->move_piece(to, from, this->piece_on(to), us);
+            this->put_piece(to, undo.captured, them);
             break;
         case ENPASSANT:
-            this->move_piece(from, to, PAWN, US);
-            this->remove_piece(to - 8, PAWN, THEM);
+            this->move_piece(to, from, PAWN, us);
+            this->put_piece(to + down, PAWN, them);
             break;
         case CASTLING:
             int rfrom, rto;
-            switch (to) {
-            case C1:
-                rto = D1;
-                rfrom = castling::rook_sqs[QUEENSIDE];
-                break;
-            case G1:
-                rto = F1;
-                rfrom = castling::rook_sqs[KINGSIDE];
-                break;
-            default:
-                rto = rfrom = -1;
-                break;
-            }
-            this->remove_piece(rfrom, ROOK, US);
-            this->remove_piece(from, KING, US);
-            this->put_piece(rto, ROOK, US);
-            this->put_piece(to, KING, US);
+            castling_rook_sqs(us, to, rfrom, rto);
+            this->remove_piece(to, KING, us);
+            this->remove_piece(rto, ROOK, us);
+            this->put_piece(from, KING, us);
+            this->put_piece(rfrom, ROOK, us);
             break;
         case PROM_CAPTURE:
-            this->remove_piece(to, this->piece_on(to), THEM);
-            this->remove_piece(from, PAWN, US);
-            this->put_piece(to, prom_type(move), US);
+            this->remove_piece(to, prom_type(move), us);
+            this->put_piece(from, PAWN, us);
+            this->put_piece(to, undo.captured, them);
             break;
         case PROMOTION:
-            this->remove_piece(from, PAWN, US);
-            this->put_piece(to, prom_type(move), US);
+            this->remove_piece(to, prom_type(move), us);
+            this->put_piece(from, PAWN, us);
             break;
         default:
             std::cout << "MOVE TYPE ERROR!" << std::endl;
             break;
     }
 
-    this->flip();
-    this->hash_key = this->calc_hash();
+    this->restore(undo);
+    assert(this->hash_key == this->calc_hash());
+    assert(this->pawn_key == this->calc_pawn_key());
+    assert(this->material_key == this->calc_material_key());
+    assert(this->is_consistent());
 }
@@ -25,6 +25,7 @@ SOFTWARE.
 #ifndef MOVE_H
 #define MOVE_H
 
+#include <cstddef>
 #include <string>
 #include "definitions.h"
 
@@ -42,6 +43,21 @@ enum MoveType
                    | DOUBLE_PUSH | CAPTURE | PROM_CAPTURE
 };
 
+enum GenType
+{
+    PSEUDO_LEGAL,
+    LEGAL
+};
+
+// Restrictions on our pieces when generating strictly legal moves,
+// computed once per position. Pseudo-legal generation leaves them empty.
+struct LegalMasks
+{
+    int ksq;
+    u64 pinned;
+    u64 king_danger;
+};
+
 enum PromotionType
 {
     PROM_NONE = 0,
@@ -69,6 +85,67 @@ inline Move get_move(u32 from, u32 to, u32 move_type, u32 cap_type=CAP_NONE, u32
     return from | (to << 6) | move_type | prom_type | (cap_type << 22);
 }
 
-extern std::string get_move_string(Move move, bool flipped);
+// 16-bit form of a move with the from and to squares, the promotion piece
+// and a castling bit. Position::expand_move restores the rest from the board.
+inline u16 compress_move(Move move)
+{
+    return (move & 0xfff) | (prom_type(move) << 12) | (bool(move & CASTLING) << 15);
+}
+
+extern std::string get_move_string(Move move);
+
+// Fixed capacity list of moves with an ordering score per move
+class MoveList
+{
+public:
+    MoveList();
+
+    void push_back(Move move);
+    void pop_back();
+    void clear();
+    void resize(std::size_t new_size);
+    bool empty() const;
+    std::size_t size() const;
+    Move back() const;
+    Move& operator[](std::size_t i);
+    Move operator[](std::size_t i) const;
+    int& score(std::size_t i);
+    Move* begin();
+    Move* end();
+    const Move* begin() const;
+    const Move* end() const;
+
+private:
+    Move moves[MAX_MOVES];
+    int scores[MAX_MOVES];
+    std::size_t count;
+};
+
+inline MoveList::MoveList() : count(0) {}
+
+inline void MoveList::push_back(Move move)
+{
+    assert(this->count < MAX_MOVES);
+    this->moves[this->count++] = move;
+}
+
+inline void MoveList::pop_back()
+{
+    assert(this->count > 0);
+    --this->count;
+}
+
+inline void MoveList::clear() { this->count = 0; }
+inline void MoveList::resize(std::size_t new_size) { assert(new_size <= this->count); this->count = new_size; }
+inline bool MoveList::empty() const { return this->count == 0; }
+inline std::size_t MoveList::size() const { return this->count; }
+inline Move MoveList::back() const { return this->moves[this->count - 1]; }
+inline Move& MoveList::operator[](std::size_t i) { return this->moves[i]; }
+inline Move MoveList::operator[](std::size_t i) const { return this->moves[i]; }
+inline int& MoveList::score(std::size_t i) { return this->scores[i]; }
+inline Move* MoveList::begin() { return this->moves; }
+inline Move* MoveList::end() { return this->moves + this->count; }
+inline const Move* MoveList::begin() const { return this->moves; }
+inline const Move* MoveList::end() const { return this->moves + this->count; }
 
 #endif
@@ -22,16 +22,18 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <algorithm>
+
 #include "move.h"
 #include "position.h"
 #include "lookups.h"
 
-static inline void add_move(int move, std::vector<Move>& mlist)
+static inline void add_move(int move, MoveList& mlist)
 {
     mlist.push_back(move);
 }
 
-static inline void extract_quiets(int from, u64 bb, std::vector<Move>& mlist)
+static inline void extract_quiets(int from, u64 bb, MoveList& mlist)
 {
     while (bb) {
         add_move(get_move(from, fbitscan(bb), NORMAL), mlist);
@@ -39,7 +41,7 @@ static inline void extract_quiets(int from, u64 bb, std::vector<Move>& mlist)
     }
 }
 
-static inline void extract_captures(const Position& pos, int from, u64 bb, std::vector<Move>& mlist)
+static inline void extract_captures(const Position& pos, int from, u64 bb, MoveList& mlist)
 {
     while (bb) {
         int to = fbitscan(bb);
@@ -48,101 +50,176 @@ static inline void extract_captures(const Position& pos, int from, u64 bb, std::
     }
 }
 
-void gen_piece_captures(const Position& pos, std::vector<Move>& mlist)
+// A pinned piece may only move along the line through its king
+static inline bool pin_allows(const LegalMasks& lm, int from, int to)
+{
+    return !(lm.pinned & BB(from)) || (lookups::full_ray(from, lm.ksq) & BB(to));
+}
+
+// Destinations of a piece which do not leave our king in check
+template <bool Legal>
+inline u64 legal_targets(const LegalMasks& lm, int pt, int from, u64 targets)
+{
+    if (Legal)
+    {
+        if (pt == KING)
+            targets &= ~lm.king_danger;
+        else if (lm.pinned & BB(from))
+            targets &= lookups::full_ray(from, lm.ksq);
+    }
+    return targets;
+}
+
+// All squares attacked by the given side, sliders see through occupancy
+template <Color by_side>
+u64 attacked_squares(const Position& pos, u64 occupancy)
+{
+    typedef Relative<by_side> R;
+    u64 pawns = pos.piece_bb(PAWN, by_side);
+    u64 attacked = shift_bb<R::UP_LEFT>(pawns & ~FILE_A_MASK)
+                 | shift_bb<R::UP_RIGHT>(pawns & ~FILE_H_MASK);
+    for (int pt = KNIGHT; pt <= KING; ++pt) {
+        u64 bb = pos.piece_bb(pt, by_side);
+        while (bb) {
+            attacked |= lookups::attacks(pt, fbitscan(bb), occupancy);
+            bb &= bb - 1;
+        }
+    }
+    return attacked;
+}
+
+template <Color Us, bool Legal>
+LegalMasks get_legal_masks(const Position& pos)
+{
+    LegalMasks lm = { INVALID_SQ, 0, 0 };
+    if (Legal)
+    {
+        lm.ksq = pos.position_of(KING, Us);
+        lm.pinned = pos.pinned(Us);
+        // Our king is removed so that it cannot step back along a checking ray
+        lm.king_danger = attacked_squares<Color(!Us)>(pos, pos.occupancy_bb() ^ BB(lm.ksq));
+    }
+    return lm;
+}
+
+template <Color Us, bool Legal>
+void gen_piece_captures(const Position& pos, const LegalMasks& lm, MoveList& mlist)
 {
+    constexpr Color Them = Color(!Us);
     int from;
     u64 occupancy = pos.occupancy_bb(),
-        them = pos.color_bb(THEM);
+        them = pos.color_bb(Them);
     for (int pt = KING; pt >= KNIGHT; --pt) {
-        u64 curr_pieces = pos.piece_bb(pt, US);
+        u64 curr_pieces = pos.piece_bb(pt, Us);
         while (curr_pieces) {
             from = fbitscan(curr_pieces);
             curr_pieces &= curr_pieces - 1;
-            extract_captures(pos, from, lookups::attacks(pt, from, occupancy) & them, mlist);
+            u64 targets = lookups::attacks(pt, from, occupancy) & them;
+            extract_captures(pos, from, legal_targets<Legal>(lm, pt, from, targets), mlist);
         }
     }
 }
 
-void gen_pawn_captures(const Position& pos, std::vector<Move>& mlist) {
+template <Color Us, bool Legal>
+void gen_pawn_captures(const Position& pos, const LegalMasks& lm, MoveList& mlist) {
+    typedef Relative<Us> R;
+    constexpr Color Them = Color(!Us);
     int from;
     int cap_pt;
     u64 caps1, caps2, prom_caps1, prom_caps2;
 
-    u64 pawns = pos.piece_bb(PAWN, US);
+    u64 pawns = pos.piece_bb(PAWN, Us);
     if (pos.get_ep_sq() != INVALID_SQ) {
-        u64 ep_poss = pawns & lookups::pawn(pos.get_ep_sq(), THEM);
+        u64 ep_poss = pawns & lookups::pawn(pos.get_ep_sq(), Them);
         while (ep_poss) {
             from = fbitscan(ep_poss);
             ep_poss &= ep_poss - 1;
-            add_move(get_move(from, pos.get_ep_sq(), ENPASSANT), mlist);
+            Move move = get_move(from, pos.get_ep_sq(), ENPASSANT);
+            if (!Legal || pos.legal_move(move))
+                add_move(move, mlist);
         }
     }
 
-    caps1 = ((pawns & ~FILE_A_MASK) << 7) & pos.color_bb(THEM);
-    prom_caps1 = caps1 & RANK_8_MASK;
+    caps1 = shift_bb<R::UP_LEFT>(pawns & ~FILE_A_MASK) & pos.color_bb(Them);
+    prom_caps1 = caps1 & R::RANK_8;
     caps1 ^= prom_caps1;
 
-    caps2 = ((pawns & ~FILE_H_MASK) << 9) & pos.color_bb(THEM);
-    prom_caps2 = caps2 & RANK_8_MASK;
+    caps2 = shift_bb<R::UP_RIGHT>(pawns & ~FILE_H_MASK) & pos.color_bb(Them);
+    prom_caps2 = caps2 & R::RANK_8;
     caps2 ^= prom_caps2;
 
     int to;
     while (caps1) {
         to = fbitscan(caps1);
         caps1 &= caps1 - 1;
-        add_move(get_move(to - 7, to, CAPTURE, pos.piece_on(to)), mlist);
+        if (Legal && !pin_allows(lm, to - R::UP_LEFT, to))
+            continue;
+        add_move(get_move(to - R::UP_LEFT, to, CAPTURE, pos.piece_on(to)), mlist);
     }
     while (caps2) {
         to = fbitscan(caps2);
         caps2 &= caps2 - 1;
-        add_move(get_move(to - 9, to, CAPTURE, pos.piece_on(to)), mlist);
+        if (Legal && !pin_allows(lm, to - R::UP_RIGHT, to))
+            continue;
+        add_move(get_move(to - R::UP_RIGHT, to, CAPTURE, pos.piece_on(to)), mlist);
     }
     while (prom_caps1) {
         to = fbitscan(prom_caps1);
         prom_caps1 &= prom_caps1 - 1;
+        if (Legal && !pin_allows(lm, to - R::UP_LEFT, to))
+            continue;
         cap_pt = pos.piece_on(to);
-        add_move(get_move(to - 7, to, PROM_CAPTURE, cap_pt, PROM_TO_QUEEN), mlist);
-        add_move(get_move(to - 7, to, PROM_CAPTURE, cap_pt, PROM_TO_KNIGHT), mlist);
-        add_move(get_move(to - 7, to, PROM_CAPTURE, cap_pt, PROM_TO_BISHOP), mlist);
-        add_move(get_move(to - 7, to, PROM_CAPTURE, cap_pt, PROM_TO_ROOK), mlist);
+        add_move(get_move(to - R::UP_LEFT, to, PROM_CAPTURE, cap_pt, PROM_TO_QUEEN), mlist);
+        add_move(get_move(to - R::UP_LEFT, to, PROM_CAPTURE, cap_pt, PROM_TO_KNIGHT), mlist);
+        add_move(get_move(to - R::UP_LEFT, to, PROM_CAPTURE, cap_pt, PROM_TO_BISHOP), mlist);
+        add_move(get_move(to - R::UP_LEFT, to, PROM_CAPTURE, cap_pt, PROM_TO_ROOK), mlist);
     }
     while (prom_caps2) {
         to = fbitscan(prom_caps2);
         prom_caps2 &= prom_caps2 - 1;
+        if (Legal && !pin_allows(lm, to - R::UP_RIGHT, to))
+            continue;
         cap_pt = pos.piece_on(to);
-        add_move(get_move(to - 9, to, PROM_CAPTURE, cap_pt, PROM_TO_QUEEN), mlist);
-        add_move(get_move(to - 9, to, PROM_CAPTURE, cap_pt, PROM_TO_KNIGHT), mlist);
-        add_move(get_move(to - 9, to, PROM_CAPTURE, cap_pt, PROM_TO_BISHOP), mlist);
-        add_move(get_move(to - 9, to, PROM_CAPTURE, cap_pt, PROM_TO_ROOK), mlist);
+        add_move(get_move(to - R::UP_RIGHT, to, PROM_CAPTURE, cap_pt, PROM_TO_QUEEN), mlist);
+        add_move(get_move(to - R::UP_RIGHT, to, PROM_CAPTURE, cap_pt, PROM_TO_KNIGHT), mlist);
+        add_move(get_move(to - R::UP_RIGHT, to, PROM_CAPTURE, cap_pt, PROM_TO_BISHOP), mlist);
+        add_move(get_move(to - R::UP_RIGHT, to, PROM_CAPTURE, cap_pt, PROM_TO_ROOK), mlist);
     }
 }
 
-void gen_quiet_promotions(const Position& pos, std::vector<Move>& mlist)
+template <Color Us, bool Legal>
+void gen_quiet_promotions(const Position& pos, const LegalMasks& lm, MoveList& mlist)
 {
-    u64 prom_destinations = ((pos.piece_bb(PAWN, US) & RANK_7_MASK) << 8) & ~pos.occupancy_bb();
+    typedef Relative<Us> R;
+    u64 prom_destinations = shift_bb<R::UP>(pos.piece_bb(PAWN, Us) & R::RANK_7)
+                           & ~pos.occupancy_bb();
     while (prom_destinations) {
         int to = fbitscan(prom_destinations);
         prom_destinations &= prom_destinations - 1;
-        add_move(get_move(to - 8, to, PROMOTION, CAP_NONE, PROM_TO_QUEEN), mlist);
-        add_move(get_move(to - 8, to, PROMOTION, CAP_NONE, PROM_TO_KNIGHT), mlist);
-        add_move(get_move(to - 8, to, PROMOTION, CAP_NONE, PROM_TO_BISHOP), mlist);
-        add_move(get_move(to - 8, to, PROMOTION, CAP_NONE, PROM_TO_ROOK), mlist);
+        if (Legal && !pin_allows(lm, to - R::UP, to))
+            continue;
+        add_move(get_move(to - R::UP, to, PROMOTION, CAP_NONE, PROM_TO_QUEEN), mlist);
+        add_move(get_move(to - R::UP, to, PROMOTION, CAP_NONE, PROM_TO_KNIGHT), mlist);
+        add_move(get_move(to - R::UP, to, PROMOTION, CAP_NONE, PROM_TO_BISHOP), mlist);
+        add_move(get_move(to - R::UP, to, PROMOTION, CAP_NONE, PROM_TO_ROOK), mlist);
     }
 }
 
-void gen_castling(const Position& pos, std::vector<Move>& mlist)
+template <Color Us>
+void gen_castling(const Position& pos, MoveList& mlist)
 {
-    static int const castling_side[2] = { US_OO, US_OOO };
-    static int const king_end_pos[2] = { G1, C1 };
-    static int const rook_end_pos[2] = { F1, D1 };
+    constexpr Color Them = Color(!Us);
+    static int const castling_side[2] = { WHITE_OO << (2 * Us), WHITE_OOO << (2 * Us) };
+    static int const king_end_pos[2] = { relative_sq(Us, G1), relative_sq(Us, C1) };
+    static int const rook_end_pos[2] = { relative_sq(Us, F1), relative_sq(Us, D1) };
 
-    if (!pos.checkers_to(US)) {
-        int ksq = pos.position_of(KING, US);
+    if (!pos.checkers_to<Us>()) {
+        int ksq = pos.position_of(KING, Us);
         for (int i = KINGSIDE; i <= QUEENSIDE; ++i) {
             if (castling_side[i] & pos.get_castling_rights()) {
                 int king_end_sq = king_end_pos[i],
                     rook_end_sq = rook_end_pos[i];
-                int rsq = castling::rook_sqs[i];
+                int rsq = relative_sq(Us, castling::rook_sqs[i]);
                 u64 occupancy = pos.occupancy_bb() ^ BB(ksq) ^ BB(rsq);
 
                 assert(pos.check_piece_on(rsq, ROOK));
@@ -159,7 +236,7 @@ void gen_castling(const Position& pos, std::vector<Move>& mlist)
                 while (intermediate_sqs) {
                     int sq = fbitscan(intermediate_sqs);
                     intermediate_sqs &= intermediate_sqs - 1;
-                    if (pos.attackers_to(sq, THEM)) {
+                    if (pos.attackers_to<Them>(sq, pos.occupancy_bb())) {
                         can_castle = false;
                         break;
                     }
@@ -172,51 +249,65 @@ void gen_castling(const Position& pos, std::vector<Move>& mlist)
     }
 }
 
-void gen_piece_quiets(const Position& pos, std::vector<Move>& mlist)
+template <Color Us, bool Legal>
+void gen_piece_quiets(const Position& pos, const LegalMasks& lm, MoveList& mlist)
 {
     u64 occupancy = pos.occupancy_bb();
     u64 vacancy = ~occupancy;
     for (int pt = KNIGHT; pt <= KING; ++pt) {
-        u64 curr_pieces = pos.piece_bb(pt, US);
+        u64 curr_pieces = pos.piece_bb(pt, Us);
         while (curr_pieces) {
             int from = fbitscan(curr_pieces);
             curr_pieces &= curr_pieces - 1;
-            extract_quiets(from, lookups::attacks(pt, from, occupancy) & vacancy, mlist);
+            u64 targets = lookups::attacks(pt, from, occupancy) & vacancy;
+            extract_quiets(from, legal_targets<Legal>(lm, pt, from, targets), mlist);
         }
     }
 }
 
-void gen_pawn_quiets(const Position& pos, std::vector<Move>& mlist)
+template <Color Us, bool Legal>
+void gen_pawn_quiets(const Position& pos, const LegalMasks& lm, MoveList& mlist)
 {
+    typedef Relative<Us> R;
     u64 vacancy = ~pos.occupancy_bb();
-    u64 single_pushes_bb = ((pos.piece_bb(PAWN, US) & ~RANK_7_MASK) << 8) & vacancy;
-    u64 double_pushes_bb = ((single_pushes_bb & RANK_3_MASK) << 8) & vacancy;
+    u64 single_pushes_bb = shift_bb<R::UP>(pos.piece_bb(PAWN, Us) & ~R::RANK_7) & vacancy;
+    u64 double_pushes_bb = shift_bb<R::UP>(single_pushes_bb & R::RANK_3) & vacancy;
     while (single_pushes_bb) {
         int to = fbitscan(single_pushes_bb);
         single_pushes_bb &= single_pushes_bb - 1;
-        add_move(get_move(to - 8, to, NORMAL), mlist);
+        if (Legal && !pin_allows(lm, to - R::UP, to))
+            continue;
+        add_move(get_move(to - R::UP, to, NORMAL), mlist);
     }
     while (double_pushes_bb) {
         int to = fbitscan(double_pushes_bb);
         double_pushes_bb &= double_pushes_bb - 1;
-        add_move(get_move(to - 16, to, DOUBLE_PUSH), mlist);
+        if (Legal && !pin_allows(lm, to - 2 * R::UP, to))
+            continue;
+        add_move(get_move(to - 2 * R::UP, to, DOUBLE_PUSH), mlist);
     }
 }
 
-void gen_checker_captures(const Position& pos, u64 checkers, std::vector<Move>& mlist)
+template <Color Us, bool Legal>
+void gen_checker_captures(const Position& pos, const LegalMasks& lm, u64 checkers, MoveList& mlist)
 {
-    u64 our_pawns = pos.piece_bb(PAWN, US);
-    u64 non_king_mask = ~pos.piece_bb(KING);
+    typedef Relative<Us> R;
+    constexpr Color Them = Color(!Us);
+    u64 our_pawns = pos.piece_bb(PAWN, Us);
+    // A pinned piece can never capture a checker
+    u64 non_king_mask = ~(pos.piece_bb(KING) | lm.pinned);
     u64 occupancy = pos.occupancy_bb();
     int ep_sq = pos.get_ep_sq();
 
-    if (ep_sq != INVALID_SQ && ((BB(ep_sq) >> 8) & checkers))
+    if (ep_sq != INVALID_SQ && (shift_bb<-R::UP>(BB(ep_sq)) & checkers))
     {
-        u64 enpassanters = our_pawns & lookups::pawn(ep_sq, THEM);
+        u64 enpassanters = our_pawns & lookups::pawn(ep_sq, Them);
         while (enpassanters) {
             int attacker_sq = fbitscan(enpassanters);
             enpassanters &= enpassanters - 1;
-            add_move(get_move(attacker_sq, ep_sq, ENPASSANT), mlist);
+            Move move = get_move(attacker_sq, ep_sq, ENPASSANT);
+            if (!Legal || pos.legal_move(move))
+                add_move(move, mlist);
         }
     }
 
@@ -224,12 +315,12 @@ void gen_checker_captures(const Position& pos, u64 checkers, std::vector<Move>&
         int checker_sq = fbitscan(checkers);
         int checker_pt = pos.piece_on(checker_sq);
         checkers &= checkers - 1;
-        u64 attackers = pos.attackers_to(checker_sq, US, occupancy) & non_king_mask;
+        u64 attackers = pos.attackers_to<Us>(checker_sq, occupancy) & non_king_mask;
         while (attackers) {
             int attacker_sq = fbitscan(attackers);
             attackers &= attackers - 1;
             if (   (BB(attacker_sq) & our_pawns)
-                && (BB(checker_sq) & RANK_8_MASK))
+                && (BB(checker_sq) & R::RANK_8))
             {
                 add_move(get_move(attacker_sq, checker_sq, PROM_CAPTURE,
                                   checker_pt, PROM_TO_QUEEN), mlist);
@@ -248,21 +339,25 @@ void gen_checker_captures(const Position& pos, u64 checkers, std::vector<Move>&
     }
 }
 
-void gen_check_blocks(const Position& pos, u64 blocking_possibilites, std::vector<Move>& mlist)
+template <Color Us, bool Legal>
+void gen_check_blocks(const Position& pos, const LegalMasks& lm, u64 blocking_possibilites, MoveList& mlist)
 {
-    u64 our_pawns = pos.piece_bb(PAWN, US);
-    u64 inclusion_mask = ~(our_pawns | pos.piece_bb(KING) | pos.pinned(US));
+    typedef Relative<Us> R;
+    u64 our_pawns = pos.piece_bb(PAWN, Us);
+    u64 pinned = Legal ? lm.pinned : pos.pinned(Us);
+    u64 pushable_pawns = our_pawns & ~pinned;
+    u64 inclusion_mask = ~(our_pawns | pos.piece_bb(KING) | pinned);
     u64 occupancy = pos.occupancy_bb();
     u64 vacancy_mask = ~occupancy;
 
     while (blocking_possibilites) {
         int blocking_sq = fbitscan(blocking_possibilites);
         blocking_possibilites &= blocking_possibilites - 1;
-        u64 pawn_blockers = BB(blocking_sq) >> 8;
-        if (pawn_blockers & our_pawns)
+        u64 pawn_blockers = shift_bb<-R::UP>(BB(blocking_sq));
+        if (pawn_blockers & pushable_pawns)
         {
             int blocker_sq = fbitscan(pawn_blockers);
-            if (BB(blocking_sq) & RANK_8_MASK)
+            if (BB(blocking_sq) & R::RANK_8)
             {
                 add_move(get_move(blocker_sq, blocking_sq, PROMOTION,
                                   CAP_NONE, PROM_TO_QUEEN), mlist);
@@ -278,15 +373,15 @@ void gen_check_blocks(const Position& pos, u64 blocking_possibilites, std::vecto
                 add_move(get_move(blocker_sq, blocking_sq, NORMAL), mlist);
             }
         }
-        else if(   (rank_of(blocking_sq) == RANK_4)
+        else if(   (BB(blocking_sq) & R::RANK_4)
                 && (pawn_blockers & vacancy_mask)
-                && (pawn_blockers = (pawn_blockers >> 8) & our_pawns))
+                && (pawn_blockers = shift_bb<-R::UP>(pawn_blockers) & pushable_pawns))
         {
             add_move(get_move(fbitscan(pawn_blockers), blocking_sq,
                               DOUBLE_PUSH), mlist);
         }
 
-        u64 candidate_blockers = pos.attackers_to(blocking_sq, US, occupancy)
+        u64 candidate_blockers = pos.attackers_to<Us>(blocking_sq, occupancy)
                                & inclusion_mask;
         while (candidate_blockers) {
             add_move(get_move(fbitscan(candidate_blockers), blocking_sq,
@@ -296,21 +391,29 @@ void gen_check_blocks(const Position& pos, u64 blocking_possibilites, std::vecto
     }
 }
 
-void Position::generate_in_check_movelist(std::vector<Move>& mlist) const
+template <Color Us, bool Legal>
+void gen_in_check_movelist(const Position& pos, MoveList& mlist)
 {
-    int ksq = this->position_of(KING, US);
-    u64 checkers = this->checkers_to(US);
-    u64 evasions = lookups::king(ksq) & ~this->color_bb(US);
+    constexpr Color Them = Color(!Us);
+    LegalMasks lm = get_legal_masks<Us, Legal>(pos);
+    int ksq = pos.position_of(KING, Us);
+    u64 checkers = pos.checkers_to<Us>();
+    u64 evasions = lookups::king(ksq) & ~pos.color_bb(Us);
 
-    u64 occupancy = this->occupancy_bb();
+    u64 occupancy = pos.occupancy_bb();
     u64 sans_king = occupancy ^ BB(ksq);
 
+    // Evasions are legal in both modes, the danger set only replaces the
+    // per-square attack test
+    if (Legal)
+        evasions &= ~lm.king_danger;
+
     while (evasions) {
         int sq = fbitscan(evasions);
         evasions &= evasions - 1;
-        if (!this->attackers_to(sq, THEM, sans_king)) {
+        if (Legal || !pos.attackers_to<Them>(sq, sans_king)) {
             if (occupancy & BB(sq))
-                add_move(get_move(ksq, sq, CAPTURE, this->piece_on(sq)), mlist);
+                add_move(get_move(ksq, sq, CAPTURE, pos.piece_on(sq)), mlist);
             else
                 add_move(get_move(ksq, sq, NORMAL), mlist);
         }
@@ -319,45 +422,211 @@ void Position::generate_in_check_movelist(std::vector<Move>& mlist) const
     if (checkers & (checkers - 1))
         return;
 
-    gen_checker_captures(*this, checkers, mlist);
+    gen_checker_captures<Us, Legal>(pos, lm, checkers, mlist);
 
     if (checkers & lookups::king(ksq))
         return;
 
     u64 blocking_possibilites = lookups::intervening_sqs(fbitscan(checkers), ksq);
     if (blocking_possibilites)
-        gen_check_blocks(*this, blocking_possibilites, mlist);
+        gen_check_blocks<Us, Legal>(pos, lm, blocking_possibilites, mlist);
 }
 
-void Position::generate_quiesce_movelist(std::vector<Move>& mlist) const
+template <Color Us, bool Legal>
+void gen_quiesce_movelist(const Position& pos, const LegalMasks& lm, MoveList& mlist)
 {
-    const Position& pos = *this;
-    gen_piece_captures(pos, mlist);
-    gen_pawn_captures(pos, mlist);
-    gen_quiet_promotions(pos, mlist);
+    assert(!Legal || !pos.checkers_to<Us>());
+    gen_piece_captures<Us, Legal>(pos, lm, mlist);
+    gen_pawn_captures<Us, Legal>(pos, lm, mlist);
+    gen_quiet_promotions<Us, Legal>(pos, lm, mlist);
 }
 
-void Position::generate_movelist(std::vector<Move>& mlist) const
+template <Color Us, bool Legal>
+void gen_movelist(const Position& pos, MoveList& mlist)
 {
-    const Position& pos = *this;
-    gen_piece_captures(pos, mlist);
-    gen_pawn_captures(pos, mlist);
-    gen_quiet_promotions(pos, mlist);
-    gen_castling(pos, mlist);
-    gen_piece_quiets(pos, mlist);
-    gen_pawn_quiets(pos, mlist);
+    assert(!Legal || !pos.checkers_to<Us>());
+    LegalMasks lm = get_legal_masks<Us, Legal>(pos);
+    gen_piece_captures<Us, Legal>(pos, lm, mlist);
+    gen_pawn_captures<Us, Legal>(pos, lm, mlist);
+    gen_quiet_promotions<Us, Legal>(pos, lm, mlist);
+    gen_castling<Us>(pos, mlist);
+    gen_piece_quiets<Us, Legal>(pos, lm, mlist);
+    gen_pawn_quiets<Us, Legal>(pos, lm, mlist);
 }
 
-void Position::generate_legal_movelist(std::vector<Move>& mlist) const
+template <Color Us, bool Legal>
+void gen_quiet_movelist(const Position& pos, const LegalMasks& lm, MoveList& mlist)
 {
-    if (checkers_to(US))
-        generate_in_check_movelist(mlist);
+    assert(!Legal || !pos.checkers_to<Us>());
+    gen_castling<Us>(pos, mlist);
+    gen_piece_quiets<Us, Legal>(pos, lm, mlist);
+    gen_pawn_quiets<Us, Legal>(pos, lm, mlist);
+}
+
+template <Color Us>
+bool pseudo_legal(const Position& pos, Move move)
+{
+    typedef Relative<Us> R;
+    constexpr Color Them = Color(!Us);
+    int from = from_sq(move);
+    int to = to_sq(move);
+    int move_type = move & MOVE_TYPE_MASK;
+    int pt = pos.piece_on(from);
+    u64 occupancy = pos.occupancy_bb();
+
+    if (!(pos.color_bb(Us) & BB(from)))
+        return false;
+
+    // The king may castle onto its own rook in Chess960
+    if (move_type == CASTLING)
+    {
+        MoveList castling_moves;
+        gen_castling<Us>(pos, castling_moves);
+        return std::find(castling_moves.begin(), castling_moves.end(), move)
+            != castling_moves.end();
+    }
+
+    if (pos.color_bb(Us) & BB(to))
+        return false;
+
+    // Capture and promotion types must match the board and the move type
+    bool is_capture = move_type == CAPTURE || move_type == PROM_CAPTURE;
+    bool is_promotion = move_type == PROMOTION || move_type == PROM_CAPTURE;
+    if (is_capture != bool(pos.color_bb(Them) & BB(to)))
+        return false;
+    if (cap_type(move) != (is_capture ? u32(pos.piece_on(to)) : u32(CAP_NONE)))
+        return false;
+    if (is_promotion ? prom_type(move) < KNIGHT || prom_type(move) > QUEEN
+                     : prom_type(move) != PROM_NONE)
+        return false;
+
+    if (pt == PAWN)
+    {
+        bool last_rank = BB(to) & R::RANK_8;
+        switch (move_type) {
+        case NORMAL:
+            return to == from + R::UP && !last_rank;
+        case PROMOTION:
+            return to == from + R::UP && last_rank;
+        case DOUBLE_PUSH:
+            return to == from + 2 * R::UP
+                && (BB(from + R::UP) & R::RANK_3 & ~occupancy);
+        case CAPTURE:
+            return (lookups::pawn(from, Us) & BB(to)) && !last_rank;
+        case PROM_CAPTURE:
+            return (lookups::pawn(from, Us) & BB(to)) && last_rank;
+        case ENPASSANT:
+            return to == pos.get_ep_sq() && (lookups::pawn(from, Us) & BB(to));
+        default:
+            return false;
+        }
+    }
+
+    return (move_type == NORMAL || move_type == CAPTURE)
+        && (lookups::attacks(pt, from, occupancy) & BB(to));
+}
+
+void Position::generate_in_check_movelist(MoveList& mlist, GenType type) const
+{
+    if (this->side == WHITE)
+        type == LEGAL ? gen_in_check_movelist<WHITE, true>(*this, mlist)
+                      : gen_in_check_movelist<WHITE, false>(*this, mlist);
+    else
+        type == LEGAL ? gen_in_check_movelist<BLACK, true>(*this, mlist)
+                      : gen_in_check_movelist<BLACK, false>(*this, mlist);
+}
+
+void Position::generate_quiesce_movelist(MoveList& mlist, GenType type) const
+{
+    if (type == LEGAL)
+        generate_quiesce_movelist(mlist, this->legal_masks());
+    else if (this->side == WHITE)
+        gen_quiesce_movelist<WHITE, false>(*this, get_legal_masks<WHITE, false>(*this), mlist);
+    else
+        gen_quiesce_movelist<BLACK, false>(*this, get_legal_masks<BLACK, false>(*this), mlist);
+}
+
+void Position::generate_quiesce_movelist(MoveList& mlist, const LegalMasks& lm) const
+{
+    this->side == WHITE ? gen_quiesce_movelist<WHITE, true>(*this, lm, mlist)
+                        : gen_quiesce_movelist<BLACK, true>(*this, lm, mlist);
+}
+
+void Position::generate_movelist(MoveList& mlist, GenType type) const
+{
+    if (this->side == WHITE)
+        type == LEGAL ? gen_movelist<WHITE, true>(*this, mlist)
+                      : gen_movelist<WHITE, false>(*this, mlist);
     else
-        generate_movelist(mlist);
-    for (std::size_t i = 0; i < mlist.size();) {
-        if (!legal_move(mlist[i]))
-            mlist.erase(mlist.begin() + i);
-        else
-            ++i;
+        type == LEGAL ? gen_movelist<BLACK, true>(*this, mlist)
+                      : gen_movelist<BLACK, false>(*this, mlist);
+}
+
+void Position::generate_quiet_movelist(MoveList& mlist, GenType type) const
+{
+    if (type == LEGAL)
+        generate_quiet_movelist(mlist, this->legal_masks());
+    else if (this->side == WHITE)
+        gen_quiet_movelist<WHITE, false>(*this, get_legal_masks<WHITE, false>(*this), mlist);
+    else
+        gen_quiet_movelist<BLACK, false>(*this, get_legal_masks<BLACK, false>(*this), mlist);
+}
+
+void Position::generate_quiet_movelist(MoveList& mlist, const LegalMasks& lm) const
+{
+    this->side == WHITE ? gen_quiet_movelist<WHITE, true>(*this, lm, mlist)
+                        : gen_quiet_movelist<BLACK, true>(*this, lm, mlist);
+}
+
+// Pins and king danger of the side to move, shared by the legal stages of a
+// staged generation
+LegalMasks Position::legal_masks() const
+{
+    return this->side == WHITE ? get_legal_masks<WHITE, true>(*this)
+                               : get_legal_masks<BLACK, true>(*this);
+}
+
+bool Position::is_pseudo_legal(Move move) const
+{
+    return this->side == WHITE ? pseudo_legal<WHITE>(*this, move)
+                               : pseudo_legal<BLACK>(*this, move);
+}
+
+// Rebuilds the move type and capture type of a compressed move from the
+// board. The result still has to be checked with is_pseudo_legal.
+Move Position::expand_move(u16 move) const
+{
+    if (!move)
+        return 0;
+
+    int from = move & 0x3f;
+    int to = (move >> 6) & 0x3f;
+    u32 prom = (move >> 12) & 7;
+    if (move & 0x8000)
+        return get_move(from, to, CASTLING);
+
+    bool is_capture = this->color_bb(!this->side) & BB(to);
+    if (prom)
+        return is_capture
+            ? get_move(from, to, PROM_CAPTURE, this->piece_on(to), prom << 19)
+            : get_move(from, to, PROMOTION, CAP_NONE, prom << 19);
+
+    if (this->piece_on(from) == PAWN)
+    {
+        if (to == this->ep_sq)
+            return get_move(from, to, ENPASSANT);
+        if (to == from + 16 || from == to + 16)
+            return get_move(from, to, DOUBLE_PUSH);
     }
+
+    return is_capture ? get_move(from, to, CAPTURE, this->piece_on(to))
+                      : get_move(from, to, NORMAL);
+}
+
+void Position::generate_legal_movelist(MoveList& mlist) const
+{
+    if (this->checkers())
+        generate_in_check_movelist(mlist, LEGAL);
+    else
+        generate_movelist(mlist, LEGAL);
 }
@@ -0,0 +1,232 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "movepicker.h"
+#include "evaluate.h"
+
+enum MoveOrder
+{
+    HASH_MOVE = 300000,
+    GOOD_CAP = 280000,
+    PROM = 270000,
+    KILLER = 260000,
+    BAD_CAP = 250000,
+};
+
+MovePicker::MovePicker(const Position& pos, MoveList& mlist, Move tt_move,
+                       const Move* killers, const int (*history)[64])
+    : pos(pos), mlist(mlist), tt_move(tt_move), killers(killers),
+      history(history), killer_index(0), curr(0), end_captures(0),
+      bad_captures(0)
+{
+    if (pos.checkers())
+    {
+        this->stage = GEN_EVASIONS;
+    }
+    else
+    {
+        this->stage = TT_MOVE;
+        this->masks = pos.legal_masks();
+    }
+}
+
+MovePicker::MovePicker(const Position& pos, MoveList& mlist, Move tt_move,
+                       const int (*history)[64])
+    : pos(pos), mlist(mlist), tt_move(tt_move), killers(nullptr),
+      history(history), killer_index(0), curr(0), end_captures(0),
+      bad_captures(0)
+{
+    this->stage = pos.checkers() ? GEN_EVASIONS : GEN_QS_CAPTURES;
+}
+
+int MovePicker::capture_score(Move move) const
+{
+    if (move & PROMOTION)
+        return PROM + prom_type(move);
+
+    // MVV-LVA within the winning and the losing captures
+    int cap_val = move & ENPASSANT ? piece_value[PAWN].value()
+                                   : piece_value[pos.piece_on(to_sq(move))].value();
+    int capper_pt = pos.piece_on(from_sq(move));
+    if (move & PROM_CAPTURE)
+        cap_val += piece_value[prom_type(move)].value();
+
+    if (pos.see_ge(move, 0))
+        return GOOD_CAP + cap_val - capper_pt;
+    else
+        return BAD_CAP + cap_val - capper_pt;
+}
+
+int MovePicker::quiet_score(Move move) const
+{
+    return this->history[pos.piece_on(from_sq(move))]
+                        [relative_sq(pos.get_side(), to_sq(move))];
+}
+
+bool MovePicker::is_killer(Move move) const
+{
+    return this->killers
+        && (move == this->killers[0] || move == this->killers[1]);
+}
+
+// Selection sort step, moves the best scored move in [begin, end) to begin
+Move MovePicker::pick_best(std::size_t begin, std::size_t end)
+{
+    std::size_t best = begin;
+    for (std::size_t i = begin + 1; i < end; ++i) {
+        if (mlist.score(i) > mlist.score(best))
+            best = i;
+    }
+    std::swap(mlist[begin], mlist[best]);
+    std::swap(mlist.score(begin), mlist.score(best));
+    return mlist[begin];
+}
+
+Move MovePicker::next_move()
+{
+    switch (this->stage) {
+    case TT_MOVE:
+        ++this->stage;
+        if (   this->tt_move
+            && pos.is_pseudo_legal(this->tt_move)
+            && pos.legal_move(this->tt_move))
+        {
+            return this->tt_move;
+        }
+        // Stale or colliding entry, nothing to skip in the later stages
+        this->tt_move = 0;
+        [[fallthrough]];
+
+    case GEN_CAPTURES:
+        mlist.clear();
+        pos.generate_quiesce_movelist(mlist, this->masks);
+        for (std::size_t i = 0; i < mlist.size(); ++i)
+            mlist.score(i) = capture_score(mlist[i]);
+        this->end_captures = mlist.size();
+        ++this->stage;
+        [[fallthrough]];
+
+    case GOOD_CAPTURES:
+        while (this->curr < this->end_captures) {
+            Move move = pick_best(this->curr, this->end_captures);
+            // Captures are picked best first, so the rest are all bad too
+            if (mlist.score(this->curr) < KILLER)
+                break;
+            ++this->curr;
+            if (move != this->tt_move)
+                return move;
+        }
+        this->bad_captures = this->curr;
+        ++this->stage;
+        [[fallthrough]];
+
+    case KILLERS:
+        while (this->killer_index < 2) {
+            Move killer = this->killers[this->killer_index++];
+            if (   killer
+                && killer != this->tt_move
+                && pos.is_pseudo_legal(killer)
+                && pos.legal_move(killer))
+            {
+                return killer;
+            }
+        }
+        ++this->stage;
+        [[fallthrough]];
+
+    case GEN_QUIETS:
+        pos.generate_quiet_movelist(mlist, this->masks);
+        for (std::size_t i = this->end_captures; i < mlist.size(); ++i)
+            mlist.score(i) = quiet_score(mlist[i]);
+        this->curr = this->end_captures;
+        ++this->stage;
+        [[fallthrough]];
+
+    case QUIETS:
+        while (this->curr < mlist.size()) {
+            Move move = pick_best(this->curr++, mlist.size());
+            if (move != this->tt_move && !is_killer(move))
+                return move;
+        }
+        this->curr = this->bad_captures;
+        ++this->stage;
+        [[fallthrough]];
+
+    case BAD_CAPTURES:
+        while (this->curr < this->end_captures) {
+            Move move = pick_best(this->curr++, this->end_captures);
+            if (move != this->tt_move)
+                return move;
+        }
+        this->stage = NO_MORE_MOVES;
+        return 0;
+
+    case GEN_EVASIONS:
+        mlist.clear();
+        pos.generate_in_check_movelist(mlist, LEGAL);
+        for (std::size_t i = 0; i < mlist.size(); ++i) {
+            Move move = mlist[i];
+            if (move == this->tt_move)
+                mlist.score(i) = HASH_MOVE;
+            else if (move & (CAPTURE_MASK | PROMOTION))
+                mlist.score(i) = capture_score(move);
+            else if (is_killer(move))
+                mlist.score(i) = KILLER - (move != this->killers[0]);
+            else
+                mlist.score(i) = quiet_score(move);
+        }
+        ++this->stage;
+        [[fallthrough]];
+
+    case EVASIONS:
+        if (this->curr < mlist.size())
+            return pick_best(this->curr++, mlist.size());
+        this->stage = NO_MORE_MOVES;
+        return 0;
+
+    case QS_CAPTURES:
+        if (this->curr < mlist.size())
+        {
+            Move move = pick_best(this->curr, mlist.size());
+            // Captures losing material by SEE are pruned from qsearch
+            if (mlist.score(this->curr++) >= KILLER)
+                return move;
+        }
+        this->stage = NO_MORE_MOVES;
+        return 0;
+
+    case GEN_QS_CAPTURES:
+        mlist.clear();
+        pos.generate_quiesce_movelist(mlist, LEGAL);
+        // A tt move which is not a capture or promotion is never generated
+        for (std::size_t i = 0; i < mlist.size(); ++i)
+            mlist.score(i) = mlist[i] == this->tt_move ? HASH_MOVE
+                                                       : capture_score(mlist[i]);
+        this->stage = QS_CAPTURES;
+        return next_move();
+
+    default:
+        return 0;
+    }
+}
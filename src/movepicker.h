@@ -0,0 +1,83 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef MOVEPICKER_H
+#define MOVEPICKER_H
+
+#include "definitions.h"
+#include "position.h"
+#include "move.h"
+
+enum PickerStage
+{
+    TT_MOVE,
+    GEN_CAPTURES,
+    GOOD_CAPTURES,
+    KILLERS,
+    GEN_QUIETS,
+    QUIETS,
+    BAD_CAPTURES,
+    GEN_EVASIONS,
+    EVASIONS,
+    GEN_QS_CAPTURES,
+    QS_CAPTURES,
+    NO_MORE_MOVES
+};
+
+// Hands out the moves of a position one at a time, best first. Each stage is
+// only generated and scored once the previous one runs out, so a cutoff on an
+// early move never pays for generating the quiet moves.
+class MovePicker
+{
+public:
+    // Main search: tt move, good captures, killers, quiets, bad captures
+    MovePicker(const Position& pos, MoveList& mlist, Move tt_move,
+               const Move* killers, const int (*history)[64]);
+    // Quiescence search: captures and promotions only, tt move first
+    MovePicker(const Position& pos, MoveList& mlist, Move tt_move,
+               const int (*history)[64]);
+
+    Move next_move();
+
+private:
+    int capture_score(Move move) const;
+    int quiet_score(Move move) const;
+    bool is_killer(Move move) const;
+    Move pick_best(std::size_t begin, std::size_t end);
+
+    const Position& pos;
+    MoveList& mlist;
+    Move tt_move;
+    const Move* killers;
+    const int (*history)[64];
+    // Shared by the capture and the quiet stages
+    LegalMasks masks;
+    int stage;
+    int killer_index;
+    std::size_t curr;
+    std::size_t end_captures;
+    std::size_t bad_captures;
+};
+
+#endif
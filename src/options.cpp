@@ -23,6 +23,7 @@ SOFTWARE.
 */
 
 #include "tt.h"
+#include "threadpool.h"
 #include "options.h"
 #include "position.h"
 #include "definitions.h"
@@ -39,7 +40,8 @@ namespace options
 {
     std::unordered_map<std::string, SpinOption> spins {
         { "Hash", { 1, 1, 1048576, [](int s) { tt.resize(s); } } },
-        { "Threads", { 1, 1, MAX_THREADS, nullptr } },
+        { "Threads", { 1, 1, MAX_THREADS, [](int n) { thread_pool.resize(n); } } },
+        { "PawnHash", { 2, 1, 1024, nullptr } },
         { "Contempt", { 20, -100, 100, nullptr } }
     };
     std::unordered_map<std::string, CheckOption> checks {
@@ -0,0 +1,63 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef PAWNS_H
+#define PAWNS_H
+
+#include <memory>
+
+#include "definitions.h"
+#include "score.h"
+
+// Everything the evaluation derives from the pawns alone. The value is from
+// white's point of view.
+struct PawnEntry
+{
+    u64 key;
+    Score value;
+    u64 passed[2];
+    u64 attacks[2];
+    u64 blocked[2];
+};
+
+// Pawn structure evaluations by pawn key. Every search thread has its own
+// table, so entries need no synchronization. A zeroed entry is the correct
+// entry for a position without pawns.
+class PawnTable
+{
+public:
+    void resize(int mb);
+    int size_mb() const;
+    PawnEntry& probe(u64 key);
+
+private:
+    std::unique_ptr<PawnEntry[]> entries;
+    u64 mask = 0;
+    int mb = 0;
+};
+
+inline int PawnTable::size_mb() const { return this->mb; }
+inline PawnEntry& PawnTable::probe(u64 key) { return this->entries[key & this->mask]; }
+
+#endif
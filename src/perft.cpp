@@ -0,0 +1,237 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <sstream>
+#include <vector>
+
+#include "perft.h"
+#include "move.h"
+#include "utils.h"
+#include "threadpool.h"
+
+PerftTable::PerftTable(int mb)
+{
+    // Largest power of two number of entries that fits
+    u64 size = 1;
+    while (size * 2 * sizeof(PerftEntry) <= u64(mb) << 20)
+        size *= 2;
+    this->entries = std::make_unique<PerftEntry[]>(size);
+    for (u64 i = 0; i < size; ++i) {
+        this->entries[i].key.store(0, std::memory_order_relaxed);
+        this->entries[i].data.store(0, std::memory_order_relaxed);
+    }
+    this->mask = size - 1;
+}
+
+// Legal moves are counted in bulk at the last ply instead of being made
+u64 perft_count(Position& pos, int depth, PerftTable* table)
+{
+    if (depth == 0)
+        return u64(1);
+
+    u64 leaves = u64(0);
+    if (depth > 1 && table && table->probe(pos.get_hash_key(), depth, leaves))
+        return leaves;
+
+    MoveList mlist;
+    pos.generate_legal_movelist(mlist);
+    if (depth == 1)
+        return mlist.size();
+
+    UndoInfo undo;
+    for (Move move : mlist) {
+        pos.make_move(move, undo);
+        leaves += perft_count(pos, depth - 1, table);
+        pos.unmake_move(move, undo);
+    }
+
+    if (table)
+        table->store(pos.get_hash_key(), depth, leaves);
+    return leaves;
+}
+
+struct PerftTask
+{
+    std::size_t root_index;
+    Move reply;
+};
+
+namespace perft
+{
+    u64 count(const Position& pos, int depth, int threads, PerftTable* table,
+              bool divide)
+    {
+        if (depth <= 0)
+            return u64(1);
+
+        Position root = pos;
+        MoveList root_moves;
+        root.generate_legal_movelist(root_moves);
+        std::vector<u64> counts(root_moves.size(), u64(0));
+
+        if (depth <= 2)
+        {
+            UndoInfo undo;
+            for (std::size_t i = 0; i < root_moves.size(); ++i) {
+                root.make_move(root_moves[i], undo);
+                counts[i] = perft_count(root, depth - 1, table);
+                root.unmake_move(root_moves[i], undo);
+            }
+        }
+        else
+        {
+            // Every reply to every root move is a task, which keeps the
+            // threads busy even when a few root moves have large subtrees
+            std::vector<PerftTask> tasks;
+            UndoInfo undo;
+            for (std::size_t i = 0; i < root_moves.size(); ++i) {
+                root.make_move(root_moves[i], undo);
+                MoveList replies;
+                root.generate_legal_movelist(replies);
+                for (Move reply : replies)
+                    tasks.push_back({i, reply});
+                root.unmake_move(root_moves[i], undo);
+            }
+
+            std::vector<std::atomic<u64>> task_counts(root_moves.size());
+            for (auto& task_count : task_counts)
+                task_count = 0;
+            std::atomic<std::size_t> next_task {0};
+            auto worker = [&]() {
+                std::size_t t;
+                while ((t = next_task++) < tasks.size()) {
+                    Position child = pos;
+                    child.make_move(root_moves[tasks[t].root_index]);
+                    child.make_move(tasks[t].reply);
+                    task_counts[tasks[t].root_index]
+                        += perft_count(child, depth - 2, table);
+                }
+            };
+
+            // The caller sizes the pool to at least the perft thread count
+            thread_pool.start([&](int threadnum) {
+                if (threadnum < threads)
+                    worker();
+            });
+            worker();
+            thread_pool.wait();
+
+            for (std::size_t i = 0; i < root_moves.size(); ++i)
+                counts[i] = task_counts[i];
+        }
+
+        u64 leaves = u64(0);
+        for (std::size_t i = 0; i < root_moves.size(); ++i) {
+            leaves += counts[i];
+            if (divide)
+                std::cout << get_move_string(root_moves[i]) << ": "
+                          << counts[i] << std::endl;
+        }
+        return leaves;
+    }
+
+    bool suite(const std::string& path, int threads, PerftTable* table,
+               int max_depth)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            std::cout << "info string cannot open " << path << std::endl;
+            return false;
+        }
+
+        // Position::init overwrites the castling globals, which the current
+        // UCI position still relies on afterwards
+        bool frc_option = castling::is_frc;
+        int rook_sqs[2];
+        u8 spoilers[64];
+        std::copy(std::begin(castling::rook_sqs), std::end(castling::rook_sqs), rook_sqs);
+        std::copy(std::begin(castling::spoilers), std::end(castling::spoilers), spoilers);
+        int passed = 0;
+        int failed = 0;
+        u64 total_nodes = u64(0);
+        time_ms start_time = utils::curr_time();
+        std::string line;
+        while (std::getline(file, line)) {
+            std::size_t fields_end = line.find(';');
+            if (fields_end == std::string::npos)
+                continue;
+            std::string fen = line.substr(0, fields_end);
+            fen.erase(fen.find_last_not_of(' ') + 1);
+            std::stringstream fields(fen);
+            std::string board, side, rights;
+            if (!(fields >> board >> side >> rights))
+                continue;
+
+            // Shredder-FEN castling files mark a Chess960 position
+            castling::is_frc = rights.find_first_not_of("KQkq-") != std::string::npos;
+            Position pos;
+            std::stringstream stream(fen);
+            pos.init(stream);
+
+            std::stringstream entries(line.substr(fields_end));
+            std::string tag;
+            u64 expected;
+            while (entries >> tag >> expected) {
+                if (tag.size() < 3 || tag.compare(0, 2, ";D"))
+                    continue;
+                int depth = std::stoi(tag.substr(2));
+                if (depth > max_depth)
+                    continue;
+
+                u64 nodes = count(pos, depth, threads, table);
+                total_nodes += nodes;
+                if (nodes == expected)
+                {
+                    ++passed;
+                }
+                else
+                {
+                    ++failed;
+                    std::cout << "info string FAIL " << fen
+                              << " depth " << depth
+                              << " nodes " << nodes
+                              << " expected " << expected << std::endl;
+                }
+            }
+        }
+        castling::is_frc = frc_option;
+        std::copy(std::begin(rook_sqs), std::end(rook_sqs), castling::rook_sqs);
+        std::copy(std::begin(spoilers), std::end(spoilers), castling::spoilers);
+
+        time_ms elapsed = utils::curr_time() - start_time;
+        std::cout << "info string perftsuite"
+                  << " passed " << passed
+                  << " failed " << failed
+                  << " nodes " << total_nodes
+                  << " time " << elapsed
+                  << " mnps " << (elapsed ? total_nodes / 1000.0 / elapsed : 0.0)
+                  << std::endl;
+        return !failed;
+    }
+}
@@ -0,0 +1,88 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "position.h"
+
+struct PerftEntry
+{
+    std::atomic<u64> key;
+    std::atomic<u64> data;
+};
+
+// Subtree counts by (key, depth), shared between the perft threads. Entries
+// are written locklessly and verified by the key ^ data trick.
+class PerftTable
+{
+public:
+    PerftTable(int mb);
+    bool probe(u64 key, int depth, u64& count) const;
+    void store(u64 key, int depth, u64 count);
+
+private:
+    std::unique_ptr<PerftEntry[]> entries;
+    u64 mask;
+};
+
+inline bool PerftTable::probe(u64 key, int depth, u64& count) const
+{
+    const PerftEntry& entry = this->entries[key & this->mask];
+    u64 data = entry.data.load(std::memory_order_relaxed);
+    if (   (entry.key.load(std::memory_order_relaxed) ^ data) != key
+        || int(data & 0xff) != depth)
+    {
+        return false;
+    }
+    count = data >> 8;
+    return true;
+}
+
+inline void PerftTable::store(u64 key, int depth, u64 count)
+{
+    PerftEntry& entry = this->entries[key & this->mask];
+    u64 data = (count << 8) | u64(depth);
+    entry.key.store(key ^ data, std::memory_order_relaxed);
+    entry.data.store(data, std::memory_order_relaxed);
+}
+
+namespace perft
+{
+    // Leaf nodes at the given depth. The tree is split two plies deep over
+    // the threads, and the table is optional.
+    extern u64 count(const Position& pos, int depth, int threads,
+                     PerftTable* table, bool divide=false);
+
+    // Runs every ";D<depth> <nodes>" entry of an EPD file up to max_depth,
+    // returns whether all of them matched
+    extern bool suite(const std::string& path, int threads, PerftTable* table,
+                      int max_depth);
+}
+
+#endif
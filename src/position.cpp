@@ -39,37 +39,21 @@ char piece_char(int pt, int c)
     case KING: pchar = 'k'; break;
     default: pchar = 'd'; break;
     }
-    return c == US ? std::toupper(pchar) : pchar;
+    return c == WHITE ? std::toupper(pchar) : pchar;
 }
 
-void Position::flip()
+// Checks that the board array agrees with the bitboards
+bool Position::is_consistent() const
 {
-    for (u64* bb = this->bb; bb < this->bb + NUM_PIECE_TYPES; ++bb)
-        *bb = __builtin_bswap64(*bb);
-    for (u64* bb = this->color; bb < this->color + NUM_COLORS; ++bb)
-        *bb = __builtin_bswap64(*bb);
-
-    u64 tmp_color = this->color[1];
-    this->color[1] = this->color[0];
-    this->color[0] = tmp_color;
-
-    if (this->ep_sq != INVALID_SQ)
-        this->ep_sq ^= 56;
-
-    std::uint8_t tmp_cr = (this->castling_rights & 3) << 2;
-    this->castling_rights >>= 2;
-    this->castling_rights ^= tmp_cr;
-
-    this->flipped = !this->flipped;
-}
-
-int Position::piece_on(int sq) const
-{
-    u64 sq_bb = BB(sq);
-    for (int pt = PAWN; pt < NUM_PIECE_TYPES; ++pt)
-        if (this->bb[pt] & sq_bb)
-            return pt;
-    return NO_PIECE;
+    for (int sq = A1; sq < NUM_SQUARES; ++sq) {
+        int pt = NO_PIECE;
+        for (int i = PAWN; i < NUM_PIECE_TYPES; ++i)
+            if (this->bb[i] & BB(sq))
+                pt = i;
+        if (this->board[sq] != pt)
+            return false;
+    }
+    return true;
 }
 
 void Position::display()
@@ -84,10 +68,7 @@ void Position::display()
         }
         else
         {
-            int color = ((this->color_bb(US) & BB(sq ^ 56)) && !this->is_flipped())
-                     || ((this->color_bb(THEM) & BB(sq ^ 56)) && this->is_flipped())
-                      ? US
-                      : THEM;
+            int color = (this->color_bb(WHITE) & BB(sq ^ 56)) ? WHITE : BLACK;
             std::cout << piece_char(piece, color) << " ";
         }
     }
@@ -102,13 +83,15 @@ void Position::clear()
         this->bb[i] = 0;
     for (int i = 0; i < 2; ++i)
         this->color[i] = 0;
-    this->flipped = false;
+    for (int i = 0; i < 64; ++i)
+        this->board[i] = NO_PIECE;
+    this->side = WHITE;
     this->ep_sq = INVALID_SQ;
     this->castling_rights = 0;
     this->half_moves = 0;
     this->hash_key = 0;
-    this->prev_hash_keys.clear();
-    this->prev_hash_keys.reserve(100);
+    this->pawn_key = 0;
+    this->material_key = 0;
 }
 
 void Position::init(std::stringstream& stream)
@@ -150,18 +133,18 @@ void Position::init(std::stringstream& stream)
             int sq = i ^ 56;
             int pt, pc;
             switch (c) {
-            case 'p': pt = PAWN, pc = THEM; break;
-            case 'r': pt = ROOK, pc = THEM; break;
-            case 'n': pt = KNIGHT, pc = THEM; break;
-            case 'b': pt = BISHOP, pc = THEM; break;
-            case 'q': pt = QUEEN, pc = THEM; break;
-            case 'k': pt = KING, pc = THEM; break;
-            case 'P': pt = PAWN, pc = US; break;
-            case 'R': pt = ROOK, pc = US; break;
-            case 'N': pt = KNIGHT, pc = US; break;
-            case 'B': pt = BISHOP, pc = US; break;
-            case 'Q': pt = QUEEN, pc = US; break;
-            case 'K': pt = KING, pc = US; break;
+            case 'p': pt = PAWN, pc = BLACK; break;
+            case 'r': pt = ROOK, pc = BLACK; break;
+            case 'n': pt = KNIGHT, pc = BLACK; break;
+            case 'b': pt = BISHOP, pc = BLACK; break;
+            case 'q': pt = QUEEN, pc = BLACK; break;
+            case 'k': pt = KING, pc = BLACK; break;
+            case 'P': pt = PAWN, pc = WHITE; break;
+            case 'R': pt = ROOK, pc = WHITE; break;
+            case 'N': pt = KNIGHT, pc = WHITE; break;
+            case 'B': pt = BISHOP, pc = WHITE; break;
+            case 'Q': pt = QUEEN, pc = WHITE; break;
+            case 'K': pt = KING, pc = WHITE; break;
             default : pt = -1, pc = -1; break; // Error
             }
             this->put_piece(sq, pt, pc);
@@ -171,10 +154,10 @@ void Position::init(std::stringstream& stream)
 
     if (castling::is_frc)
     {
-        int ksq = this->position_of(KING, US);
+        int ksq = this->position_of(KING, WHITE);
         castling::spoilers[ksq] = 12;
         castling::spoilers[ksq ^ 56] = 3;
-        u64 rook_bb = this->piece_bb(ROOK, US);
+        u64 rook_bb = this->piece_bb(ROOK, WHITE);
         while (rook_bb) {
             int rsq = fbitscan(rook_bb);
             rook_bb &= rook_bb - 1;
@@ -195,7 +178,7 @@ void Position::init(std::stringstream& stream)
 
     // Side to move
     stream >> part;
-    bool need_to_flip = part == "b";
+    this->side = part == "b" ? BLACK : WHITE;
 
     // Castling
     stream >> part;
@@ -207,20 +190,20 @@ void Position::init(std::stringstream& stream)
         else if (!castling::is_frc)
         {
             switch (c) {
-            case 'K': this->castling_rights |= US_OO; break;
-            case 'Q': this->castling_rights |= US_OOO; break;
-            case 'k': this->castling_rights |= THEM_OO; break;
-            case 'q': this->castling_rights |= THEM_OOO; break;
+            case 'K': this->castling_rights |= WHITE_OO; break;
+            case 'Q': this->castling_rights |= WHITE_OOO; break;
+            case 'k': this->castling_rights |= BLACK_OO; break;
+            case 'q': this->castling_rights |= BLACK_OOO; break;
             default: break;
             }
         }
         else
         {
             switch (c) {
-            case 'K': this->castling_rights |= US_OO; break;
-            case 'Q': this->castling_rights |= US_OOO; break;
-            case 'k': this->castling_rights |= THEM_OO; break;
-            case 'q': this->castling_rights |= THEM_OOO; break;
+            case 'K': this->castling_rights |= WHITE_OO; break;
+            case 'Q': this->castling_rights |= WHITE_OOO; break;
+            case 'k': this->castling_rights |= BLACK_OO; break;
+            case 'q': this->castling_rights |= BLACK_OOO; break;
             default: break;
             }
 
@@ -230,9 +213,9 @@ void Position::init(std::stringstream& stream)
                 int rank = RANK_8;
                 int rsq = get_sq(file, rank);
                 if (castling::rook_sqs[KINGSIDE] == (rsq^56))
-                    this->castling_rights |= THEM_OO;
+                    this->castling_rights |= BLACK_OO;
                 else
-                    this->castling_rights |= THEM_OOO;
+                    this->castling_rights |= BLACK_OOO;
             }
             else
             {
@@ -240,9 +223,9 @@ void Position::init(std::stringstream& stream)
                 int rank = RANK_1;
                 int rsq = get_sq(file, rank);
                 if (castling::rook_sqs[KINGSIDE] == rsq)
-                    this->castling_rights |= US_OO;
+                    this->castling_rights |= WHITE_OO;
                 else
-                    this->castling_rights |= US_OOO;
+                    this->castling_rights |= WHITE_OOO;
             }
         }
     }
@@ -267,10 +250,9 @@ void Position::init(std::stringstream& stream)
     int full_moves; // dummy
     stream >> full_moves;
 
-    if (need_to_flip)
-        this->flip();
-
     this->hash_key = this->calc_hash();
+    this->pawn_key = this->calc_pawn_key();
+    this->material_key = this->calc_material_key();
 }
 
 u64 Position::attackers_to(int sq) const
@@ -280,7 +262,7 @@ u64 Position::attackers_to(int sq) const
 
 u64 Position::attackers_to(int sq, int by_side) const
 {
-    return this->attackers_to(sq) & this->color_bb(by_side);
+    return this->attackers_to(sq, by_side, this->occupancy_bb());
 }
 
 u64 Position::attackers_to(int sq, u64 occupancy) const
@@ -288,29 +270,21 @@ u64 Position::attackers_to(int sq, u64 occupancy) const
     return (lookups::rook(sq, occupancy) & (piece_bb(ROOK) | piece_bb(QUEEN)))
          | (lookups::bishop(sq, occupancy) & (piece_bb(BISHOP) | piece_bb(QUEEN)))
          | (lookups::knight(sq) & piece_bb(KNIGHT))
-         | (lookups::pawn(sq, US) & piece_bb(PAWN, THEM))
-         | (lookups::pawn(sq, THEM) & piece_bb(PAWN, US))
+         | (lookups::pawn(sq, WHITE) & piece_bb(PAWN, BLACK))
+         | (lookups::pawn(sq, BLACK) & piece_bb(PAWN, WHITE))
          | (lookups::king(sq) & piece_bb(KING));
 }
 
 u64 Position::attackers_to(int sq, int by_side, u64 occupancy) const
 {
-    return this->attackers_to(sq, occupancy) & this->color_bb(by_side);
-}
-
-u64 Position::checkers_to(int side) const
-{
-    return attackers_to(this->position_of(KING, side), !side);
+    return by_side == WHITE ? this->attackers_to<WHITE>(sq, occupancy)
+                            : this->attackers_to<BLACK>(sq, occupancy);
 }
 
-u64 Position::calc_hash()
+u64 Position::calc_hash() const
 {
-    bool flipped = this->is_flipped();
-    if (flipped)
-        this->flip();
-
     u64 hash_key = u64(0);
-    for (int c = US; c <= THEM; ++c) {
+    for (int c = WHITE; c <= BLACK; ++c) {
         for (int pt = PAWN; pt <= KING; ++pt) {
             u64 bb = this->piece_bb(pt, c);
             while (bb) {
@@ -325,14 +299,36 @@ u64 Position::calc_hash()
 
     hash_key ^= lookups::castle_key(this->castling_rights);
 
-    if (flipped) {
+    if (this->side == BLACK)
         hash_key ^= lookups::stm_key();
-        this->flip();
-    }
 
     return hash_key;
 }
 
+// Zobrist key of the pawns alone, for the pawn hash table
+u64 Position::calc_pawn_key() const
+{
+    u64 pawn_key = u64(0);
+    for (int c = WHITE; c <= BLACK; ++c) {
+        u64 bb = this->piece_bb(PAWN, c);
+        while (bb) {
+            pawn_key ^= lookups::psq_key(c, PAWN, fbitscan(bb));
+            bb &= bb - 1;
+        }
+    }
+    return pawn_key;
+}
+
+u64 Position::calc_material_key() const
+{
+    u64 material_key = u64(0);
+    for (int c = WHITE; c <= BLACK; ++c) {
+        for (int pt = PAWN; pt < KING; ++pt)
+            material_key += material::unit(c, pt) * popcnt(this->piece_bb(pt, c));
+    }
+    return material_key;
+}
+
 u64 Position::pinned(int side) const
 {
     int ksq = this->position_of(KING, side);
@@ -358,98 +354,160 @@ u64 Position::pinned(int side) const
 
 bool Position::is_passed_pawn(int sq) const
 {
-    return this->piece_on(sq) == PAWN
-        && !(lookups::passed_pawn_mask(sq) & this->piece_bb(PAWN, THEM))
-        && !(lookups::north(sq) & this->piece_bb(PAWN, US));
+    int us = this->side;
+    return this->check_piece_on(sq, PAWN)
+        && !(lookups::passed_pawn_mask(us, sq) & this->piece_bb(PAWN, !us))
+        && !(lookups::forward_file(us, sq) & this->piece_bb(PAWN, us));
 }
 
-u64 Position::perft(int depth, bool root) const
+bool Position::is_repetition(const HashHistory& history, int ply) const
 {
-    if (depth == 0)
-        return u64(1);
-
-    std::vector<Move> mlist;
-    generate_legal_movelist(mlist);
-
-    u64 leaves = u64(0);
-    for (Move move : mlist) {
-        Position pos = *this;
-        pos.make_move(move);
-        if (pos.checkers_to(THEM))
-            continue;
-        u64 count = pos.perft(depth - 1, false);
-        leaves += count;
-        if (root)
-            std::cout << get_move_string(move, !pos.is_flipped()) << ": "
-                      << count << std::endl;
-    }
-
-    return leaves;
+    return history.is_repetition(ply, this->get_hash_key(),
+                                 this->get_half_moves());
 }
 
-bool Position::is_repetition() const
+// Material value used by the exchange evaluation, kings are never captured
+inline int see_value(int pt)
 {
-    assert(this->prev_hash_keys.size() == this->get_half_moves());
-    u64 curr_hash = this->get_hash_key();
-    int num_keys = this->prev_hash_keys.size();
-    for (int i = num_keys - 2; i >= num_keys - this->get_half_moves(); i -= 2)
-        if (prev_hash_keys[i] == curr_hash)
-            return true;
-    return false;
+    return pt < KING ? piece_value[pt].value() : 0;
 }
 
-Move Position::smallest_capture_move(int sq) const
+// Least valuable piece of the given side among the attackers, its square is
+// returned through sq
+int Position::least_valuable_attacker(u64 attackers, int c, int& sq) const
 {
-    int sq_pt = this->piece_on(sq);
-    if (sq_pt == PAWN)
-    {
-        u64 candidates_bb = lookups::pawn(sq, THEM) & this->piece_bb(PAWN, US);
-        if (candidates_bb)
+    for (int pt = PAWN; pt <= KING; ++pt) {
+        u64 bb = attackers & this->piece_bb(pt, c);
+        if (bb)
         {
-            if (rank_of(sq) == RANK_8)
-                return get_move(fbitscan(candidates_bb), sq, PROM_CAPTURE, sq_pt,
-                                QUEEN);
+            sq = fbitscan(bb);
+            return pt;
         }
     }
-    u64 forward_mask = lookups::north_region(sq) | lookups::east(sq);
-    u64 backward_mask = lookups::south_region(sq) | lookups::west(sq);
-    for (int pt = PAWN; pt <= KING; ++pt) {
-        u64 candidates_bb = pt == PAWN
-                          ? lookups::pawn(sq, THEM)
-                          : lookups::attacks(pt, sq, this->occupancy_bb());
-        candidates_bb &= this->piece_bb(pt, US);
-        u64 backward_candidates = candidates_bb & backward_mask;
-        if (backward_candidates)
-            return get_move(rbitscan(backward_candidates), sq, CAPTURE, sq_pt);
-        u64 forward_candidates = candidates_bb & forward_mask;
-        if (forward_candidates)
-            return get_move(fbitscan(forward_candidates), sq, CAPTURE, sq_pt);
+    return NO_PIECE;
+}
+
+// Swap list exchange evaluation on the destination square, sliders behind
+// each capturer are uncovered through the occupancy
+int Position::see(Move move) const
+{
+    if (move & CASTLING)
+        return 0;
+
+    int from = from_sq(move);
+    int to = to_sq(move);
+    int attacker = this->piece_on(from);
+    u64 occupancy = this->occupancy_bb() ^ BB(from);
+    int gain[32];
+    gain[0] = see_value(this->piece_on(to));
+    if (move & ENPASSANT)
+    {
+        gain[0] = see_value(PAWN);
+        occupancy ^= BB(to ^ 8);
+    }
+    if (move & (PROMOTION | PROM_CAPTURE))
+    {
+        attacker = prom_type(move);
+        gain[0] += see_value(attacker) - see_value(PAWN);
     }
 
-    return 0;
+    u64 diagonal = this->piece_bb(BISHOP) | this->piece_bb(QUEEN);
+    u64 straight = this->piece_bb(ROOK) | this->piece_bb(QUEEN);
+    u64 attackers = this->attackers_to(to, occupancy) & occupancy;
+    int c = !this->side;
+    int d = 0;
+    int sq = INVALID_SQ;
+    while (attackers & this->color_bb(c)) {
+        int pt = this->least_valuable_attacker(attackers, c, sq);
+        // The king may only take when nothing can recapture
+        if (pt == KING && (attackers & this->color_bb(!c)))
+            break;
+
+        ++d;
+        gain[d] = see_value(attacker) - gain[d - 1];
+
+        occupancy ^= BB(sq);
+        attackers |= (lookups::bishop(to, occupancy) & diagonal)
+                   | (lookups::rook(to, occupancy) & straight);
+        attackers &= occupancy;
+        attacker = pt;
+        c = !c;
+    }
+
+    while (d) {
+        gain[d - 1] = -std::max(-gain[d - 1], gain[d]);
+        --d;
+    }
+    return gain[0];
 }
 
-int Position::see(int sq) const
+// Whether the exchange started by the move gains at least the threshold,
+// stopping as soon as the outcome is settled
+bool Position::see_ge(Move move, int threshold) const
 {
-    Position pos = *this;
-    Move smallest_cap = pos.smallest_capture_move(sq);
-    if (!smallest_cap)
-        return 0;
-    int pt = pos.piece_on(sq);
-    if (pt != NO_PIECE)
+    if (move & CASTLING)
+        return threshold <= 0;
+
+    int from = from_sq(move);
+    int to = to_sq(move);
+    int attacker = this->piece_on(from);
+    u64 occupancy = this->occupancy_bb() ^ BB(from);
+    int swap = see_value(this->piece_on(to));
+    if (move & ENPASSANT)
     {
-        int piece_val = piece_value[pt].value();
-        if (smallest_cap & PROMOTION_TYPE_MASK)
-            piece_val += piece_value[prom_type(smallest_cap)].value();
-        pos.make_move(smallest_cap);
-        return std::max(0, piece_val - pos.see(sq ^ 56));
+        swap = see_value(PAWN);
+        occupancy ^= BB(to ^ 8);
+    }
+    if (move & (PROMOTION | PROM_CAPTURE))
+    {
+        attacker = prom_type(move);
+        swap += see_value(attacker) - see_value(PAWN);
+    }
+
+    // Best case, we keep the captured material
+    swap -= threshold;
+    if (swap < 0)
+        return false;
+
+    // Worst case, our piece is lost for nothing and we are still ahead
+    swap = see_value(attacker) - swap;
+    if (swap <= 0)
+        return true;
+
+    u64 diagonal = this->piece_bb(BISHOP) | this->piece_bb(QUEEN);
+    u64 straight = this->piece_bb(ROOK) | this->piece_bb(QUEEN);
+    u64 attackers = this->attackers_to(to, occupancy) & occupancy;
+    int c = this->side;
+    bool result = true;
+    int sq = INVALID_SQ;
+    while (true) {
+        c = !c;
+        attackers &= occupancy;
+        if (!(attackers & this->color_bb(c)))
+            break;
+
+        int pt = this->least_valuable_attacker(attackers, c, sq);
+        // Taking with the king only works if the other side is out of attackers
+        if (pt == KING)
+            return (attackers & this->color_bb(!c)) ? result : !result;
+
+        result = !result;
+        swap = see_value(pt) - swap;
+        if (swap < result)
+            break;
+
+        occupancy ^= BB(sq);
+        if (pt == PAWN || pt == BISHOP || pt == QUEEN)
+            attackers |= lookups::bishop(to, occupancy) & diagonal;
+        if (pt == ROOK || pt == QUEEN)
+            attackers |= lookups::rook(to, occupancy) & straight;
     }
-    return 0;
+    return result;
 }
 
-bool Position::is_drawn() const
+bool Position::is_drawn(const HashHistory& history, int ply) const
 {
-    if (get_half_moves() > 99 || is_repetition())
+    if (get_half_moves() > 99 || is_repetition(history, ply))
         return true;
     int num_pieces = popcnt(occupancy_bb());
     if (num_pieces == 2)
@@ -464,8 +522,8 @@ bool Position::is_drawn() const
         if (popcnt(piece_bb(KNIGHT)) == 2)
             return true;
 
-        int num_us = popcnt(color_bb(US));
-        int num_them = popcnt(color_bb(THEM));
+        int num_us = popcnt(color_bb(WHITE));
+        int num_them = popcnt(color_bb(BLACK));
         if (num_us == num_them)
             return true;
         else if (popcnt(piece_bb(BISHOP)) == 2)
@@ -30,8 +30,14 @@ SOFTWARE.
 #include <string>
 #include <sstream>
 #include <vector>
+#include <type_traits>
 #include "definitions.h"
+#include "hash_history.h"
 #include "lookups.h"
+#include "material.h"
+#include "move.h"
+
+struct EvalTables;
 
 namespace castling
 {
@@ -40,6 +46,16 @@ namespace castling
     inline u8 spoilers[64];
 }
 
+// State which cannot be recovered from a move when it is unmade
+struct UndoInfo
+{
+    u64 hash_key;
+    int ep_sq;
+    int captured;
+    std::uint8_t castling_rights;
+    std::uint8_t half_moves;
+};
+
 inline bool allow_ponder = true;
 inline bool mcts = false;
 
@@ -52,13 +68,14 @@ public:
 
     // Misc
     void display();
-    u64 perft(int depth, bool root=true) const;
 
     // Getters
     u64 get_hash_key() const;
+    u64 get_pawn_key() const;
+    u64 get_material_key() const;
     std::uint8_t get_castling_rights() const;
     std::uint8_t get_half_moves() const;
-    bool is_flipped() const;
+    int get_side() const;
     bool is_kingside(int sq, int c) const;
     bool is_queenside(int sq, int c) const;
     bool is_passed_pawn(int sq) const;
@@ -74,66 +91,163 @@ public:
     u64 attackers_to(int sq, int by_side) const;
     u64 attackers_to(int sq, u64 occupancy) const;
     u64 attackers_to(int sq, int by_side, u64 occupancy) const;
+    template <Color by_side>
+    u64 attackers_to(int sq, u64 occupancy) const;
+    u64 checkers() const;
     u64 checkers_to(int side) const;
+    template <Color side>
+    u64 checkers_to() const;
     u64 pinned(int to_side) const;
-    void generate_in_check_movelist(std::vector<Move>& mlist) const;
-    void generate_movelist(std::vector<Move>& mlist) const;
-    void generate_quiesce_movelist(std::vector<Move>& mlist) const;
-    void generate_legal_movelist(std::vector<Move>& mlist) const;
-    bool is_repetition() const;
+    void generate_in_check_movelist(MoveList& mlist, GenType type=PSEUDO_LEGAL) const;
+    void generate_movelist(MoveList& mlist, GenType type=PSEUDO_LEGAL) const;
+    void generate_quiesce_movelist(MoveList& mlist, GenType type=PSEUDO_LEGAL) const;
+    void generate_quiet_movelist(MoveList& mlist, GenType type=PSEUDO_LEGAL) const;
+    void generate_quiesce_movelist(MoveList& mlist, const LegalMasks& lm) const;
+    void generate_quiet_movelist(MoveList& mlist, const LegalMasks& lm) const;
+    LegalMasks legal_masks() const;
+    void generate_legal_movelist(MoveList& mlist) const;
+    bool is_repetition(const HashHistory& history, int ply) const;
+    bool is_pseudo_legal(Move move) const;
+    Move expand_move(u16 move) const;
+    u64 key_after(Move move) const;
     bool legal_move(Move move) const;
-    Move smallest_capture_move(int sq) const;
-    int see(int sq) const;
-    bool is_drawn() const;
+    int see(Move move) const;
+    bool see_ge(Move move, int threshold) const;
+    bool is_drawn(const HashHistory& history, int ply) const;
+    bool is_consistent() const;
 
     // Operations
-    void flip();
-    int evaluate();
-    std::pair<Move, Move> best_move();
+    int evaluate(EvalTables& tables);
+    std::pair<Move, Move> best_move(const HashHistory& history);
     void make_move(Move move);
+    void make_move(Move move, UndoInfo& undo);
+    void unmake_move(Move move, const UndoInfo& undo);
     void make_null_move();
+    void make_null_move(UndoInfo& undo);
+    void unmake_null_move(const UndoInfo& undo);
 
 private:
     // Internal operations
     void clear();
     void inc_half_moves();
     void reset_half_moves();
-    void clear_prev_hash_keys();
+    void save(UndoInfo& undo) const;
+    void restore(const UndoInfo& undo);
     void put_piece(int sq, int pt, int c);
     void remove_piece(int sq, int pt, int c);
     void move_piece(int from, int to, int pt, int c);
-    u64 calc_hash();
+    u64 castle_key() const;
+    u64 ep_key() const;
+    u64 calc_hash() const;
+    u64 calc_pawn_key() const;
+    u64 calc_material_key() const;
+    int least_valuable_attacker(u64 attackers, int c, int& sq) const;
 
     // Data members
     u64 bb[6];
     u64 color[2];
-    bool flipped;
+    u8 board[64];
+    int side;
     int ep_sq;
     std::uint8_t castling_rights;
     std::uint8_t half_moves;
     u64 hash_key;
-    std::vector<u64> prev_hash_keys;
+    u64 pawn_key;
+    u64 material_key;
 };
 
+static_assert(std::is_trivially_copyable<Position>::value);
+
 inline Position::Position() { this->clear(); }
 
 inline u64 Position::get_hash_key() const { return this->hash_key; }
+inline u64 Position::get_pawn_key() const { return this->pawn_key; }
+inline u64 Position::get_material_key() const { return this->material_key; }
 inline std::uint8_t Position::get_castling_rights() const { return this->castling_rights; }
 inline std::uint8_t Position::get_half_moves() const { return this->half_moves; }
-inline bool Position::is_flipped() const { return this->flipped; }
+inline int Position::get_side() const { return this->side; }
 inline bool Position::is_kingside(int sq, int c) const { return sq > this->position_of(KING, c); }
 inline bool Position::is_queenside(int sq, int c) const { return sq < this->position_of(KING, c); }
 inline int Position::get_ep_sq() const { return this->ep_sq; }
-inline u64 Position::occupancy_bb() const { return this->color_bb(US) ^ this->color_bb(THEM); }
+inline u64 Position::occupancy_bb() const { return this->color_bb(WHITE) ^ this->color_bb(BLACK); }
 inline u64 Position::piece_bb(int pt) const { return this->bb[pt]; }
 inline u64 Position::color_bb(int c) const { return this->color[c]; }
 inline u64 Position::piece_bb(int pt, int c) const { return this->bb[pt] & this->color[c]; }
 inline int Position::position_of(int pt, int c) const { return fbitscan(piece_bb(pt, c)); }
 inline bool Position::check_piece_on(int sq, int pt) const { return BB(sq) & this->piece_bb(pt); }
+inline int Position::piece_on(int sq) const { return this->board[sq]; }
 
 inline void Position::inc_half_moves() { ++this->half_moves; }
 inline void Position::reset_half_moves() { this->half_moves = 0; }
-inline void Position::clear_prev_hash_keys() { this->prev_hash_keys.clear(); }
+
+template <Color by_side>
+inline u64 Position::attackers_to(int sq, u64 occupancy) const
+{
+    constexpr Color other_side = Color(!by_side);
+    return ((lookups::rook(sq, occupancy) & (piece_bb(ROOK) | piece_bb(QUEEN)))
+          | (lookups::bishop(sq, occupancy) & (piece_bb(BISHOP) | piece_bb(QUEEN)))
+          | (lookups::knight(sq) & piece_bb(KNIGHT))
+          | (lookups::pawn(sq, other_side) & piece_bb(PAWN))
+          | (lookups::king(sq) & piece_bb(KING)))
+         & this->color_bb(by_side);
+}
+
+template <Color side>
+inline u64 Position::checkers_to() const
+{
+    constexpr Color other_side = Color(!side);
+    return this->attackers_to<other_side>(this->position_of(KING, side),
+                                          this->occupancy_bb());
+}
+
+inline u64 Position::checkers_to(int side) const
+{
+    return side == WHITE ? this->checkers_to<WHITE>() : this->checkers_to<BLACK>();
+}
+
+inline u64 Position::checkers() const
+{
+    return this->checkers_to(this->side);
+}
+
+inline void Position::save(UndoInfo& undo) const
+{
+    undo.hash_key = this->hash_key;
+    undo.ep_sq = this->ep_sq;
+    undo.captured = NO_PIECE;
+    undo.castling_rights = this->castling_rights;
+    undo.half_moves = this->half_moves;
+}
+
+inline void Position::restore(const UndoInfo& undo)
+{
+    this->hash_key = undo.hash_key;
+    this->ep_sq = undo.ep_sq;
+    this->castling_rights = undo.castling_rights;
+    this->half_moves = undo.half_moves;
+}
+
+inline void Position::make_move(Move move)
+{
+    UndoInfo undo;
+    this->make_move(move, undo);
+}
+
+inline void Position::make_null_move()
+{
+    UndoInfo undo;
+    this->make_null_move(undo);
+}
+
+inline u64 Position::castle_key() const
+{
+    return lookups::castle_key(this->castling_rights);
+}
+
+inline u64 Position::ep_key() const
+{
+    return this->ep_sq == INVALID_SQ ? 0 : lookups::ep_key(this->ep_sq);
+}
 
 inline void Position::put_piece(int sq, int pt, int c)
 {
@@ -141,6 +255,12 @@ inline void Position::put_piece(int sq, int pt, int c)
     u64 bb = BB(sq);
     this->bb[pt] ^= bb;
     this->color[c] ^= bb;
+    this->board[sq] = pt;
+    this->hash_key ^= lookups::psq_key(c, pt, sq);
+    if (pt == PAWN)
+        this->pawn_key ^= lookups::psq_key(c, PAWN, sq);
+    if (pt != KING)
+        this->material_key += material::unit(c, pt);
 }
 
 inline void Position::remove_piece(int sq, int pt, int c)
@@ -149,6 +269,12 @@ inline void Position::remove_piece(int sq, int pt, int c)
     assert(this->bb[pt] & this->color[c] & bb);
     this->bb[pt] ^= bb;
     this->color[c] ^= bb;
+    this->board[sq] = NO_PIECE;
+    this->hash_key ^= lookups::psq_key(c, pt, sq);
+    if (pt == PAWN)
+        this->pawn_key ^= lookups::psq_key(c, PAWN, sq);
+    if (pt != KING)
+        this->material_key -= material::unit(c, pt);
 }
 
 inline void Position::move_piece(int from, int to, int pt, int c)
@@ -157,6 +283,11 @@ inline void Position::move_piece(int from, int to, int pt, int c)
     u64 bb = BB(from) ^ BB(to);
     this->bb[pt] ^= bb;
     this->color[c] ^= bb;
+    this->board[from] = NO_PIECE;
+    this->board[to] = pt;
+    this->hash_key ^= lookups::psq_key(c, pt, from) ^ lookups::psq_key(c, pt, to);
+    if (pt == PAWN)
+        this->pawn_key ^= lookups::psq_key(c, PAWN, from) ^ lookups::psq_key(c, PAWN, to);
 }
 
 #endif
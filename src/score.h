@@ -29,9 +29,9 @@ SOFTWARE.
 
 struct Score
 {
-    Score() : mg(0), eg(0) {}
-    Score(int val) : mg(val), eg(val) {}
-    Score(int mg, int eg) : mg(mg), eg(eg) {}
+    constexpr Score() : mg(0), eg(0) {}
+    constexpr Score(int val) : mg(val), eg(val) {}
+    constexpr Score(int mg, int eg) : mg(mg), eg(eg) {}
 
     int value(int phase, int max_phase) const;
     int value() const;
@@ -134,7 +134,7 @@ inline const Score& Score::operator/=(const int rhs)
     return *this;
 }
 
-inline Score S(int val) { return Score(val); }
-inline Score S(int mg, int eg) { return Score(mg, eg); }
+constexpr Score S(int val) { return Score(val); }
+constexpr Score S(int mg, int eg) { return Score(mg, eg); }
 
 #endif
@@ -22,7 +22,7 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
-#include <thread>
+#include <algorithm>
 #include <atomic>
 
 #include "syzygy/tbprobe.h"
@@ -31,9 +31,12 @@ SOFTWARE.
 #include "position.h"
 #include "options.h"
 #include "move.h"
+#include "movepicker.h"
+#include "threadpool.h"
 #include "utils.h"
 #include "uci.h"
 #include "tt.h"
+#include "evalcache.h"
 
 // Statistics
 STATS(
@@ -50,25 +53,11 @@ namespace thread
 
 constexpr int MAX_HISTORY_DEPTH = 12;
 constexpr int HISTORY_LIMIT = 8000;
-constexpr int EQUAL_BOUND = 50;
-
-enum MoveOrder
-{
-    HASH_MOVE = 300000,
-    HANGING_CAP = 290000,
-    GOOD_CAP = 280000,
-    PROM = 270000,
-    KILLER = 260000,
-    BAD_CAP = 250000,
-};
-
 struct SearchStack
 {
     SearchStack()
     {
         forward_pruning = true;
-        mlist.reserve(218);
-        orderlist.reserve(218);
         pv.reserve(128);
         killer_move[0] = killer_move[1] = 0;
     }
@@ -76,8 +65,8 @@ struct SearchStack
     int ply;
     bool forward_pruning;
     Move killer_move[2];
-    std::vector<Move> mlist;
-    std::vector<int> orderlist;
+    UndoInfo undo;
+    MoveList mlist;
     std::vector<Move> pv;
 };
 
@@ -105,12 +94,12 @@ struct SearchGlobals
     u64 tb_hits;
     u64 nodes_searched;
     int history[6][64];
+    HashHistory key_history;
+    EvalTables eval_tables;
 };
 
 static SearchStack stacks[MAX_THREADS][MAX_PLY];
 static SearchGlobals globals[MAX_THREADS];
-static std::thread threads[MAX_THREADS];
-static std::pair<int, bool> results[MAX_THREADS];
 
 inline int value_to_tt(int value, int ply)
 {
@@ -130,99 +119,21 @@ inline int value_from_tt(int value, int ply)
     return value;
 }
 
-void reorder_moves(const Position& pos, SearchStack* ss, SearchGlobals& sg,
-                   Move tt_move=0)
-{
-    std::vector<Move>& mlist = ss->mlist;
-    std::vector<int>& orderlist = ss->orderlist;
-    orderlist.clear();
-
-    // Fill order vector
-    for (unsigned i = 0; i < mlist.size(); ++i) {
-        int order = 0;
-        Move move = mlist[i];
-        if (move == tt_move)
-        {
-            order = HASH_MOVE;
-        }
-        else if (move & PROMOTION)
-        {
-            order = PROM + prom_type(move);
-        }
-        else if (move == ss->killer_move[0])
-        {
-            order = KILLER;
-        }
-        else if (move == ss->killer_move[1])
-        {
-            order = KILLER - 1;
-        }
-        else if (move & CAPTURE_MASK)
-        {
-            if (move & ENPASSANT)
-            {
-                order = GOOD_CAP + 10 + PAWN;
-                goto push_order;
-            }
-
-            bool defended = pos.attackers_to(to_sq(move), THEM) > 0;
-            int cap_val = piece_value[pos.piece_on(to_sq(move))].value();
-            int capper_pt = pos.piece_on(from_sq(move));
-            if (move & PROM_CAPTURE)
-                cap_val += piece_value[prom_type(move)].value();
-
-            if (defended)
-            {
-                int cap_diff = cap_val - piece_value[capper_pt].value();
-
-                if (cap_diff > EQUAL_BOUND)
-                    order = GOOD_CAP + cap_val - capper_pt;
-                else if (cap_diff > -EQUAL_BOUND)
-                    order = GOOD_CAP + capper_pt;
-                else
-                    order = BAD_CAP - capper_pt;
-            }
-            else
-            {
-                order = HANGING_CAP + cap_val - capper_pt;
-            }
-        }
-        else
-        {
-            order = sg.history[pos.piece_on(from_sq(move))][to_sq(move)];
-        }
-
-push_order:
-        orderlist.push_back(order);
-
-        // Sort moves using insertion sort
-        int order_to_shift = orderlist[i];
-        Move move_to_shift = mlist[i];
-        int j;
-        for (j = i - 1; j >= 0 && order_to_shift > orderlist[j]; --j) {
-            orderlist[j+1] = orderlist[j];
-            mlist[j+1] = mlist[j];
-        }
-        orderlist[j+1] = order_to_shift;
-        mlist[j+1] = move_to_shift;
-    }
-
-    assert(mlist.size() == orderlist.size());
-}
-
 int qsearch(Position& pos, SearchStack* const ss, SearchGlobals& sg,
             int alpha, int beta)
 {
     ++sg.nodes_searched;
 
-    if (pos.get_half_moves() > 99 || pos.is_repetition())
+    sg.key_history.set(ss->ply, pos.get_hash_key());
+    if (   pos.get_half_moves() > 99
+        || pos.is_repetition(sg.key_history, ss->ply))
         return -options::spins["Contempt"].value;
 
     if (!(sg.nodes_searched & 2047) && (stopped() || thread::stop))
         return 0;
 
     if (ss->ply >= MAX_PLY)
-        return pos.evaluate();
+        return pos.evaluate(sg.eval_tables);
 
     // Mate distance pruning
     alpha = std::max((-MATE + ss->ply), alpha);
@@ -230,34 +141,52 @@ int qsearch(Position& pos, SearchStack* const ss, SearchGlobals& sg,
     if (alpha >= beta)
         return alpha;
 
-    bool in_check = pos.checkers_to(US);
+    // Transposition table probe, any stored depth is enough for qsearch
+    Move tt_move = 0;
+    int eval = EVAL_NONE;
+    TTEntry tt_entry;
+    if (tt.probe(pos.get_hash_key(), tt_entry))
+    {
+        int tt_score = value_from_tt(tt_entry.get_score(), ss->ply);
+        int tt_flag = tt_entry.get_flag();
+        if (    tt_flag == FLAG_EXACT
+            || (tt_flag == FLAG_LOWER && tt_score >= beta)
+            || (tt_flag == FLAG_UPPER && tt_score <= alpha))
+        {
+            return tt_score;
+        }
+        tt_move = pos.expand_move(tt_entry.get_move());
+        eval = tt_entry.get_eval();
+    }
+
+    bool in_check = pos.checkers();
     if (!in_check)
     {
-        int eval = pos.evaluate();
+        if (eval == EVAL_NONE)
+            eval = pos.evaluate(sg.eval_tables);
         if (eval >= beta)
+        {
+            tt.write(0, FLAG_LOWER, DEPTH_QS, value_to_tt(beta, ss->ply), eval,
+                     pos.get_hash_key());
             return beta;
+        }
         if (eval > alpha)
             alpha = eval;
     }
 
-    std::vector<Move>& mlist = ss->mlist;
-    mlist.clear();
-    if (in_check)
-        pos.generate_in_check_movelist(mlist);
-    else
-        pos.generate_quiesce_movelist(mlist);
-    reorder_moves(pos, ss, sg);
+    MovePicker picker(pos, ss->mlist, tt_move, sg.history);
 
+    int old_alpha = alpha;
     int legal_moves = 0;
-    for (Move move : mlist) {
-        Position child_pos = pos;
-        child_pos.make_move(move);
-        if (child_pos.checkers_to(THEM))
-            continue;
-
+    Move best_move = 0;
+    Move move;
+    while ((move = picker.next_move())) {
+        tt.prefetch(pos.key_after(move));
+        pos.make_move(move, ss->undo);
         ++legal_moves;
 
-        int value = -qsearch(child_pos, ss + 1, sg, -beta, -alpha);
+        int value = -qsearch(pos, ss + 1, sg, -beta, -alpha);
+        pos.unmake_move(move, ss->undo);
 
         if (!(sg.nodes_searched & 2047) && (stopped() || thread::stop))
             return 0;
@@ -265,13 +194,23 @@ int qsearch(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         if (value > alpha)
         {
             alpha = value;
+            best_move = move;
             if (value >= beta)
+            {
+                tt.write(move, FLAG_LOWER, DEPTH_QS,
+                         value_to_tt(beta, ss->ply), eval, pos.get_hash_key());
                 return beta;
+            }
         }
     }
 
     if (!legal_moves && in_check)
-        return -MATE + ss->ply;
+        alpha = -MATE + ss->ply;
+
+    int flag = alpha > old_alpha || (!legal_moves && in_check) ? FLAG_EXACT
+                                                                : FLAG_UPPER;
+    tt.write(best_move, flag, DEPTH_QS, value_to_tt(alpha, ss->ply), eval,
+             pos.get_hash_key());
 
     return alpha;
 }
@@ -286,11 +225,13 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
 
     ++sg.nodes_searched;
 
-    if (pos.get_half_moves() > 99 || pos.is_repetition())
+    sg.key_history.set(ss->ply, pos.get_hash_key());
+    if (   pos.get_half_moves() > 99
+        || pos.is_repetition(sg.key_history, ss->ply))
         return -options::spins["Contempt"].value;
 
     if (ss->ply >= MAX_PLY)
-        return pos.evaluate();
+        return pos.evaluate(sg.eval_tables);
 
     // Mate distance pruning
     alpha = std::max((-MATE + ss->ply), alpha);
@@ -303,17 +244,18 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         return 0;
 
     // Transposition table probe
-    bool tt_hit = false;
     int tt_score = -INFINITY;
     int tt_flag = -1;
+    int tt_eval = EVAL_NONE;
     Move tt_move = 0;
-    TTEntry tt_entry = tt.probe(pos.get_hash_key());
-    if (tt_entry.get_key() == pos.get_hash_key())
+    TTEntry tt_entry;
+    bool tt_hit = tt.probe(pos.get_hash_key(), tt_entry);
+    if (tt_hit)
     {
-        tt_hit = true;
-        tt_move = tt_entry.get_move();
+        tt_move = pos.expand_move(tt_entry.get_move());
         tt_score = value_from_tt(tt_entry.get_score(), ss->ply);
         tt_flag = tt_entry.get_flag();
+        tt_eval = tt_entry.get_eval();
         if (!pv_node && tt_entry.get_depth() >= depth)
         {
             if (    tt_flag == FLAG_EXACT
@@ -334,27 +276,31 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         && popcnt(pos.occupancy_bb()) <= (int)TB_LARGEST)
     {
         unsigned int wdl = tb_probe_wdl(
-                pos.color_bb(US), pos.color_bb(THEM),
+                pos.color_bb(WHITE), pos.color_bb(BLACK),
                 pos.piece_bb(KING), pos.piece_bb(QUEEN),
                 pos.piece_bb(ROOK), pos.piece_bb(BISHOP),
-                pos.piece_bb(KNIGHT), pos.piece_bb(PAWN), pos.get_ep_sq(),
-                true
+                pos.piece_bb(KNIGHT), pos.piece_bb(PAWN),
+                pos.get_ep_sq() == INVALID_SQ ? 0 : pos.get_ep_sq(),
+                pos.get_side() == WHITE
                 );
         if (wdl != TB_RESULT_FAILED)
         {
             ++sg.tb_hits;
             int d = std::min(depth + 6, MAX_PLY - 1);
-            tt.write(0, FLAG_EXACT, d, tb_values[wdl], pos.get_hash_key());
+            tt.write(0, FLAG_EXACT, d, tb_values[wdl], EVAL_NONE,
+                     pos.get_hash_key());
             return tb_values[wdl];
         }
 	}
 
-    int num_non_pawns = popcnt(pos.color_bb(US)
+    int num_non_pawns = popcnt(pos.color_bb(pos.get_side())
             & ~(pos.piece_bb(KING) ^ pos.piece_bb(PAWN)));
-    bool in_check = pos.checkers_to(US);
+    bool in_check = pos.checkers();
 
     // Calculate position evaluation as static eval if no tt hit, otherwise
-    // try to use the tt score based on the bound
+    // try to use the tt score based on the bound. The raw evaluation is kept
+    // in the tt entry so it is only computed once per position.
+    int eval = tt_eval;
     int static_eval;
     if (!pv_node)
     {
@@ -364,7 +310,9 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         }
         else
         {
-            static_eval = pos.evaluate();
+            if (eval == EVAL_NONE)
+                eval = pos.evaluate(sg.eval_tables);
+            static_eval = eval;
             if (tt_hit)
             {
                 if (   (static_eval < tt_score && tt_flag == FLAG_LOWER)
@@ -394,10 +342,10 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
             int reduction = 4;
             int depth_left = std::max(1, depth - reduction);
             ss[1].forward_pruning = false;
-            Position child = pos;
-            child.make_null_move();
-            int val = -search<false>(child, ss + 1, sg, -beta, -beta + 1,
+            pos.make_null_move(ss->undo);
+            int val = -search<false>(pos, ss + 1, sg, -beta, -beta + 1,
                                      depth_left);
+            pos.unmake_null_move(ss->undo);
             ss[1].forward_pruning = true;
 
             // Check if time is left
@@ -422,22 +370,12 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         search<true>(pos, ss, sg, alpha, beta, depth - 2);
         ss->forward_pruning = true;
 
-        tt_entry = tt.probe(pos.get_hash_key());
-        tt_move = tt_entry.get_move();
+        if (tt.probe(pos.get_hash_key(), tt_entry))
+            tt_move = pos.expand_move(tt_entry.get_move());
     }
 
-    // Get a pre-allocated movelist
-    std::vector<Move>& mlist = ss->mlist;
-    mlist.clear();
-
-    // Populate the movelist
-    if (in_check)
-        pos.generate_in_check_movelist(mlist);
-    else
-        pos.generate_movelist(mlist);
-
-    // Reorder the moves
-    reorder_moves(pos, ss, sg, tt_move);
+    // Moves are generated lazily into the pre-allocated movelist
+    MovePicker picker(pos, ss->mlist, tt_move, ss->killer_move, sg.history);
 
     // In-check extension
     if (in_check)
@@ -447,13 +385,12 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
     int best_value = -INFINITY,
         legal_moves = 0;
     Move best_move = 0;
-    for (Move move : mlist) {
-        // Check for legality and make move
-        Position child_pos = pos;
-        child_pos.make_move(move);
-        if (child_pos.checkers_to(THEM))
-            continue;
+    Move move;
+    while ((move = picker.next_move())) {
+        tt.prefetch(pos.key_after(move));
+        bool passed_pawn_move = pos.is_passed_pawn(from_sq(move));
 
+        pos.make_move(move, ss->undo);
         ++legal_moves;
         int depth_left = depth - 1;
 
@@ -463,13 +400,16 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
             && num_non_pawns
             && !prom_type(move)
             && !cap_type(move)
-            && !child_pos.checkers_to(US))
+            && !pos.checkers())
         {
             // Futility pruning
             if (   depth < 8
                 && !pv_node
                 && static_eval + 100 * depth_left <= alpha)
+            {
+                pos.unmake_move(move, ss->undo);
                 continue;
+            }
 
             // Late move reduction (LMR)
             if (   depth > 2
@@ -477,7 +417,7 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
                 && move != ss->killer_move[0]
                 && move != ss->killer_move[1]
                 && !in_check
-                && !pos.is_passed_pawn(from_sq(move)))
+                && !passed_pawn_move)
             {
                 depth_left -= 1 + !pv_node + (legal_moves > 10);
                 depth_left = std::max(1, depth_left);
@@ -488,17 +428,18 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         int value;
         if (legal_moves == 1)
         {
-            value = -search<pv_node>(child_pos, ss + 1, sg, -beta , -alpha,
+            value = -search<pv_node>(pos, ss + 1, sg, -beta , -alpha,
                                      depth_left);
         }
         else
         {
-            value = -search<false>(child_pos, ss + 1, sg, -alpha - 1, -alpha,
+            value = -search<false>(pos, ss + 1, sg, -alpha - 1, -alpha,
                                    depth_left);
             if (value > alpha)
-                value = -search<pv_node>(child_pos, ss + 1, sg, -beta , -alpha,
+                value = -search<pv_node>(pos, ss + 1, sg, -beta , -alpha,
                                          std::max(depth_left, depth - 1));
         }
+        pos.unmake_move(move, ss->undo);
 
         // Check if time is left
         if (!(sg.nodes_searched & 2047) && (stopped() || thread::stop))
@@ -526,7 +467,7 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
                 if (quiet_move && depth <= MAX_HISTORY_DEPTH)
                 {
                     int pt = pos.piece_on(from_sq(move));
-                    int to = to_sq(move);
+                    int to = relative_sq(pos.get_side(), to_sq(move));
                     sg.history[pt][to] += depth * depth;
 
                     // Reduce history if it overflows
@@ -554,7 +495,7 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
 
     // Check for checkmate or stalemate
     if (!legal_moves)
-        return pos.checkers_to(US)
+        return pos.checkers()
             ? -MATE + ss->ply
             : -options::spins["Contempt"].value;
 
@@ -567,7 +508,7 @@ int search(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         : FLAG_UPPER;
 
     // Create a tt entry and store it
-    tt.write(best_move, flag, depth, value_to_tt(best_value, ss->ply),
+    tt.write(best_move, flag, depth, value_to_tt(best_value, ss->ply), eval,
              pos.get_hash_key());
 
     return best_value;
@@ -579,16 +520,17 @@ int search_root(Position& pos, SearchStack* const ss, SearchGlobals& sg,
 {
     ss->pv.clear();
     ++sg.nodes_searched;
+    sg.key_history.set(ss->ply, pos.get_hash_key());
 
     // Check if time is left
     if (!(sg.nodes_searched & 2047) && (stopped() || thread::stop))
         return 0;
 
     // Transposition table probe
-    TTEntry tt_entry = tt.probe(pos.get_hash_key());
-    Move tt_move = tt_entry.get_key() == pos.get_hash_key()
-        ? tt_entry.get_move()
-        : 0;
+    TTEntry tt_entry;
+    bool tt_hit = tt.probe(pos.get_hash_key(), tt_entry);
+    Move tt_move = tt_hit ? pos.expand_move(tt_entry.get_move()) : 0;
+    int eval = tt_hit ? tt_entry.get_eval() : EVAL_NONE;
 
 	// Probe EGTB
 	// No castling allowed
@@ -599,11 +541,12 @@ int search_root(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         && popcnt(pos.occupancy_bb()) <= (int)TB_LARGEST)
     {
         unsigned int res = tb_probe_root(
-                pos.color_bb(US), pos.color_bb(THEM), pos.piece_bb(KING),
+                pos.color_bb(WHITE), pos.color_bb(BLACK), pos.piece_bb(KING),
                 pos.piece_bb(QUEEN), pos.piece_bb(ROOK),
                 pos.piece_bb(BISHOP), pos.piece_bb(KNIGHT),
-                pos.piece_bb(PAWN), pos.get_half_moves(), pos.get_ep_sq(),
-                true, nullptr
+                pos.piece_bb(PAWN), pos.get_half_moves(),
+                pos.get_ep_sq() == INVALID_SQ ? 0 : pos.get_ep_sq(),
+                pos.get_side() == WHITE, nullptr
                 );
         if (res != TB_RESULT_FAILED)
         {
@@ -635,28 +578,8 @@ int search_root(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         }
     }
 
-    // Get a pre-allocated movelist
-    std::vector<Move>& mlist = ss->mlist;
-    mlist.clear();
-
-    bool in_check = pos.checkers_to(US);
-    if (controller.limited_search)
-    {
-        std::copy(controller.search_moves.begin(),
-                  controller.search_moves.end(),
-                  std::back_inserter(mlist));
-    }
-    else
-    {
-        // Populate the movelist
-        if (in_check)
-            pos.generate_in_check_movelist(mlist);
-        else
-            pos.generate_movelist(mlist);
-    }
-
-    // Reorder the moves
-    reorder_moves(pos, ss, sg, tt_move);
+    bool in_check = pos.checkers();
+    MovePicker picker(pos, ss->mlist, tt_move, ss->killer_move, sg.history);
 
     // In-check extension
     if (in_check)
@@ -666,13 +589,16 @@ int search_root(Position& pos, SearchStack* const ss, SearchGlobals& sg,
     int best_value = -INFINITY,
         legal_moves = 0;
     Move best_move = 0;
-    for (Move move : mlist) {
-        // Check for legality and make move
-        Position child_pos = pos;
-        child_pos.make_move(move);
-        if (child_pos.checkers_to(THEM))
+    Move move;
+    while ((move = picker.next_move())) {
+        // Skip the moves that were not requested
+        if (   controller.limited_search
+            && std::find(controller.search_moves.begin(),
+                         controller.search_moves.end(), move)
+               == controller.search_moves.end())
             continue;
 
+        pos.make_move(move, ss->undo);
         ++legal_moves;
 
         // Print move being searched at root
@@ -681,8 +607,7 @@ int search_root(Position& pos, SearchStack* const ss, SearchGlobals& sg,
             controller.nodes_searched = 0;
             for (int i = 0; i < options::spins["Threads"].value; ++i)
                 controller.nodes_searched += globals[i].nodes_searched;
-            uci::print_currmove(move, legal_moves, controller.start_time,
-                                pos.is_flipped());
+            uci::print_currmove(move, legal_moves, controller.start_time);
         }
 
         int depth_left = depth - 1;
@@ -691,17 +616,18 @@ int search_root(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         int value;
         if (legal_moves == 1)
         {
-            value = -search<true>(child_pos, ss + 1, sg, -beta , -alpha,
+            value = -search<true>(pos, ss + 1, sg, -beta , -alpha,
                                   depth_left);
         }
         else
         {
-            value = -search<false>(child_pos, ss + 1, sg, -alpha - 1, -alpha,
+            value = -search<false>(pos, ss + 1, sg, -alpha - 1, -alpha,
                                    depth_left);
             if (value > alpha)
-                value = -search<true>(child_pos, ss + 1, sg, -beta , -alpha,
+                value = -search<true>(pos, ss + 1, sg, -beta , -alpha,
                                       std::max(depth_left, depth - 1));
         }
+        pos.unmake_move(move, ss->undo);
 
         // Check if time is left
         if (!(sg.nodes_searched & 2047) && (stopped() || thread::stop))
@@ -726,7 +652,7 @@ int search_root(Position& pos, SearchStack* const ss, SearchGlobals& sg,
                 if (quiet_move && depth <= MAX_HISTORY_DEPTH)
                 {
                     int pt = pos.piece_on(from_sq(move));
-                    int to = to_sq(move);
+                    int to = relative_sq(pos.get_side(), to_sq(move));
                     sg.history[pt][to] += depth * depth;
 
                     // Reduce history if it overflows
@@ -750,7 +676,7 @@ int search_root(Position& pos, SearchStack* const ss, SearchGlobals& sg,
 
     // Check for checkmate or stalemate
     if (!legal_moves)
-        return pos.checkers_to(US)
+        return pos.checkers()
             ? -MATE + ss->ply
             : -options::spins["Contempt"].value;
 
@@ -760,39 +686,36 @@ int search_root(Position& pos, SearchStack* const ss, SearchGlobals& sg,
         : FLAG_UPPER;
 
     // Create a tt entry and store it
-    tt.write(best_move, flag, depth, value_to_tt(best_value, ss->ply),
+    tt.write(best_move, flag, depth, value_to_tt(best_value, ss->ply), eval,
              pos.get_hash_key());
 
     return best_value;
 }
 
-void parallel_search(Position pos, int alpha, int beta, int depth, int threadnum)
+// Helpers deepen on their own and only share results with the main thread
+// through the transposition table
+void helper_search(Position pos, int threadnum)
 {
-    auto& [value, valid] = results[threadnum];
-    auto& sg = globals[threadnum];
+    SearchGlobals& sg = globals[threadnum];
     SearchStack* ss = stacks[threadnum];
-    valid = false; // Mark as invalid result
-
-    // Start parallel search
-    value = search_root<false>(pos, ss, sg, alpha, beta, depth);
 
-    // If this thread finished searching before the others, then thread::stop
-    // will not be set. Therefore set it to stop all others and mark this
-    // result as a valid result
-    if (!thread::stop)
-    {
-        thread::stop = true;
-        valid = true;
+    // Odd helpers start a ply deeper to spread the threads over depths
+    for (int depth = 1 + (threadnum & 1); depth <= controller.max_ply; ++depth) {
+        search_root<false>(pos, ss, sg, -INFINITY, +INFINITY, depth);
+        if (stopped() || thread::stop)
+            break;
     }
 }
 
-std::pair<Move, Move> Position::best_move()
+std::pair<Move, Move> Position::best_move(const HashHistory& history)
 {
     STATS(
             all_nodes = 0;
             search_nodes = 0;
             beta_cutoffs = 0;
             first_beta_cutoffs = 0;
+            evalcache::hits = 0;
+            evalcache::misses = 0;
          )
     constexpr int asp_delta[] = { 10, 30, 50, 100, 200, 300, INFINITY };
 
@@ -803,14 +726,12 @@ std::pair<Move, Move> Position::best_move()
         for (int ply = 0; ply < MAX_PLY; ++ply)
             stacks[i][ply].ply = ply;
 
-        // Reset results
-        results[i].first = 0;
-        results[i].second = false;
-
         // Reset globals
         globals[i].reduce_history(true);
         globals[i].nodes_searched = 0;
         globals[i].tb_hits = 0;
+        globals[i].key_history = history;
+        globals[i].eval_tables.resize(options::spins["PawnHash"].value);
     }
 
     Move best_move = 0;
@@ -820,53 +741,22 @@ std::pair<Move, Move> Position::best_move()
     int adelta;
     int bdelta;
     bool failed;
-    int result_index;
     int score = 0;
+
+    // Helpers run for the whole search, the main thread drives the
+    // aspiration windows and the time control
+    thread::stop = false;
+    // The root is copied before the main thread starts making moves on it
+    thread_pool.start([root = *this](int threadnum) {
+        helper_search(root, threadnum);
+    });
+
     for (int depth = 1; depth <= controller.max_ply; ++depth) {
         adelta = bdelta = 0;
         do {
             failed = false;
-            thread::stop = false;
-            result_index = 0; // Assume main thread has completed search
-
-            // Perform multithreaded search
-            if (depth > 4)
-            {
-                // Start helper threads
-                for (int i = 1; i < num_threads; ++i) {
-                    threads[i] = std::thread {parallel_search, *this, alpha,
-                                              beta, depth + (i & 1), i};
-                }
-
-                // Start main thread
-                results[0].first = search_root<true>(
-                    *this, stacks[0], globals[0], alpha, beta, depth
-                );
-
-                // Stop all threads
-                thread::stop = true;
-
-                // If no other thread has completed searching, main result will
-                // be used since we started by assuming the main has completed.
-                // Otherwise, join all threads and use the result of the one
-                // with the completed search.
-                for (int i = 1; i < num_threads; ++i) {
-                    threads[i].join();
-                    // If this thread has completed search, use it
-                    if (results[i].second)
-                        result_index = i;
-                }
-            }
-            // Perform single threaded search
-            else
-            {
-                results[0].first = search_root<true>(
-                    *this, stacks[0], globals[0], alpha, beta, depth
-                );
-            }
-
-            // Get the completed search result
-            score = results[result_index].first;
+            score = search_root<true>(*this, stacks[0], globals[0], alpha, beta,
+                                      depth);
 
             if (stopped())
                 break;
@@ -878,20 +768,22 @@ std::pair<Move, Move> Position::best_move()
                 controller.tb_hits += globals[i].tb_hits;
             }
 
-            SearchStack* ss = stacks[result_index];
+            SearchStack* ss = stacks[0];
             time_ms time_passed = utils::curr_time() - controller.start_time;
             int bound = score >= beta
                            ? LOWER_BOUND
                            : score <= alpha
                                ? UPPER_BOUND
                                : EXACT_BOUND;
-            uci::print_search(score, depth, bound, time_passed, ss->pv, is_flipped());
+            uci::print_search(score, depth, bound, time_passed, ss->pv);
             STATS(
                     std::cout << "info string";
                     if (beta_cutoffs)
                         std::cout << " first_beta_cutoff_rate: " << (first_beta_cutoffs / (double)beta_cutoffs);
                     std::cout << " cut_nodes_rate: " << (beta_cutoffs / (double)search_nodes)
                               << " all_nodes_rate: " << (all_nodes / (double)search_nodes)
+                              << " evalcache_hits: " << evalcache::hits
+                              << " evalcache_misses: " << evalcache::misses
                               << std::endl;
                  )
 
@@ -916,7 +808,7 @@ std::pair<Move, Move> Position::best_move()
         if (depth > 1 && stopped())
             break;
 
-        SearchStack* ss = stacks[result_index];
+        SearchStack* ss = stacks[0];
         best_move = ss->pv[0];
         ponder_move = 0;
         if (depth > 1 && ss->pv.size() > 1)
@@ -930,6 +822,9 @@ std::pair<Move, Move> Position::best_move()
         }
     }
 
+    thread::stop = true;
+    thread_pool.wait();
+
     // Do not print bestmove during go infinite or ponder
     while (controller.analyzing)
         continue;
@@ -0,0 +1,89 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "threadpool.h"
+
+ThreadPool thread_pool;
+
+ThreadPool::~ThreadPool()
+{
+    this->resize(1);
+}
+
+void ThreadPool::resize(int num_threads)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->quit = true;
+    }
+    this->wake_up.notify_all();
+    for (std::thread& worker : this->workers)
+        worker.join();
+    this->workers.clear();
+
+    this->quit = false;
+    for (int i = 1; i < num_threads; ++i)
+        this->workers.emplace_back(&ThreadPool::idle_loop, this, i,
+                                   this->generation);
+}
+
+// Runs job(index) once on every worker
+void ThreadPool::start(const std::function<void(int)>& job)
+{
+    {
+        std::lock_guard<std::mutex> lock(this->mutex);
+        this->job = job;
+        this->running = this->workers.size();
+        ++this->generation;
+    }
+    this->wake_up.notify_all();
+}
+
+void ThreadPool::wait()
+{
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->finished.wait(lock, [this]() { return !this->running; });
+}
+
+void ThreadPool::idle_loop(int index, std::uint64_t generation)
+{
+    while (true) {
+        std::unique_lock<std::mutex> lock(this->mutex);
+        this->wake_up.wait(lock, [&]() {
+            return this->quit || this->generation != generation;
+        });
+        if (this->quit)
+            return;
+
+        generation = this->generation;
+        std::function<void(int)> job = this->job;
+        lock.unlock();
+
+        job(index);
+
+        lock.lock();
+        if (!--this->running)
+            this->finished.notify_all();
+    }
+}
@@ -0,0 +1,62 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <condition_variable>
+#include <cinttypes>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Helper threads which live across searches and sleep on a condition
+// variable in between. The thread starting a job is thread 0, so a pool for
+// n threads keeps n - 1 workers.
+class ThreadPool
+{
+public:
+    ~ThreadPool();
+    void resize(int num_threads);
+    void start(const std::function<void(int)>& job);
+    void wait();
+    int size() const { return this->workers.size() + 1; }
+
+private:
+    void idle_loop(int index, std::uint64_t generation);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake_up;
+    std::condition_variable finished;
+    std::function<void(int)> job;
+    std::uint64_t generation = 0;
+    int running = 0;
+    bool quit = false;
+};
+
+extern ThreadPool thread_pool;
+
+#endif
@@ -0,0 +1,172 @@
+/*
+MIT License
+
+Copyright (c) 2018 Manik Charan
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE.
+*/
+
+#include "tt.h"
+#include "threadpool.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <new>
+
+#ifndef _WIN32
+#include <sys/mman.h>
+#else
+#include <malloc.h>
+#endif
+
+// Transparent huge pages are 2 MB on x86-64 and aarch64
+constexpr std::size_t HUGE_PAGE_SIZE = 2 << 20;
+constexpr std::size_t OS_PAGE_SIZE = 4096;
+
+TranspositionTable::TranspositionTable()
+{
+    // Fresh mmap pages are already zero, which is a cleared table. The pool
+    // may not exist yet during static initialization, so the fallback
+    // allocation is zeroed here.
+    this->allocate(1);
+#ifdef _WIN32
+    std::memset(static_cast<void*>(this->table), 0,
+                this->size * sizeof(TTCluster));
+#endif
+}
+
+TranspositionTable::TranspositionTable(std::size_t MB)
+{
+    this->resize(MB);
+}
+
+TranspositionTable::~TranspositionTable()
+{
+    this->release();
+}
+
+void TranspositionTable::resize(std::size_t MB)
+{
+    if (MB == 0)
+        MB = 1;
+    // size_t is 32 bits on 32-bit builds, where the shift would wrap
+    MB = std::min(MB, SIZE_MAX >> 20);
+
+    time_ms start = utils::curr_time();
+    this->release();
+    this->allocate(MB);
+    this->first_touch();
+    std::cout << "info string hash resized to " << MB << " MB in "
+              << utils::curr_time() - start << " ms" << std::endl;
+}
+
+// Zeroes the table, split across the search threads
+void TranspositionTable::clear()
+{
+    time_ms start = utils::curr_time();
+    this->for_each_slice([this](std::size_t begin, std::size_t end) {
+        std::memset(static_cast<void*>(this->table + begin), 0,
+                    (end - begin) * sizeof(TTCluster));
+    });
+    std::cout << "info string hash cleared in "
+              << utils::curr_time() - start << " ms" << std::endl;
+}
+
+void TranspositionTable::allocate(std::size_t MB)
+{
+    this->size = (MB << 20) / sizeof(TTCluster);
+    std::size_t bytes = this->size * sizeof(TTCluster);
+#ifndef _WIN32
+    // Whole huge pages, so the tail of the table can be backed by one too
+    this->mapped = (bytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+    void* mem = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    // Explicit huge pages, only succeeds if some have been reserved
+    mem = mmap(nullptr, this->mapped, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (mem == MAP_FAILED)
+    {
+        mem = mmap(nullptr, this->mapped, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (mem == MAP_FAILED)
+            throw std::bad_alloc();
+#ifdef MADV_HUGEPAGE
+        // Otherwise ask for transparent huge pages
+        madvise(mem, this->mapped, MADV_HUGEPAGE);
+#endif
+    }
+#else
+    this->mapped = bytes;
+    void* mem = _aligned_malloc(bytes, alignof(TTCluster));
+    if (!mem)
+        throw std::bad_alloc();
+#endif
+    this->table = static_cast<TTCluster*>(mem);
+}
+
+void TranspositionTable::release()
+{
+    if (!this->table)
+        return;
+#ifndef _WIN32
+    munmap(this->table, this->mapped);
+#else
+    _aligned_free(this->table);
+#endif
+    this->table = nullptr;
+}
+
+// Fresh mmap pages are already zero, so a freshly mapped table only needs
+// one write per page. Pages are placed on the NUMA node of the thread which
+// first writes them, so touching them from every search thread spreads the
+// table over the nodes the search runs on. The _aligned_malloc fallback
+// returns uninitialized memory, which has to be zeroed instead.
+void TranspositionTable::first_touch()
+{
+    this->for_each_slice([this](std::size_t begin, std::size_t end) {
+#ifndef _WIN32
+        char* first = reinterpret_cast<char*>(this->table + begin);
+        char* last = reinterpret_cast<char*>(this->table + end);
+        for (char* page = first; page < last; page += OS_PAGE_SIZE)
+            *reinterpret_cast<volatile char*>(page) = 0;
+#else
+        std::memset(static_cast<void*>(this->table + begin), 0,
+                    (end - begin) * sizeof(TTCluster));
+#endif
+    });
+}
+
+// Runs job(begin, end) over an equal share of the clusters on every thread
+// in the pool
+void TranspositionTable::for_each_slice(
+        const std::function<void(std::size_t, std::size_t)>& job)
+{
+    int num_threads = thread_pool.size();
+    auto slice = [&](int index) {
+        job(this->size * index / num_threads,
+            this->size * (index + 1) / num_threads);
+    };
+    thread_pool.start(slice);
+    slice(0);
+    thread_pool.wait();
+}
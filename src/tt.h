@@ -25,8 +25,13 @@ SOFTWARE.
 #ifndef TT_H
 #define TT_H
 
+#include <atomic>
 #include <cinttypes>
+#include <cstddef>
+#include <functional>
 #include <memory>
+#include "definitions.h"
+#include "move.h"
 
 enum TTConstants
 {
@@ -34,149 +39,241 @@ enum TTConstants
     FLAG_UPPER = 2,
     FLAG_LOWER = 3,
 
-    FLAG_SHIFT = 21,
-    DEPTH_SHIFT = 23,
-    SCORE_SHIFT = 32,
+    SCORE_SHIFT = 16,
+    EVAL_SHIFT = 32,
+    DEPTH_SHIFT = 48,
+    FLAG_SHIFT = 56,
+    AGE_SHIFT = 58,
 
-    MOVE_MASK = 0x1fffff,
+    MOVE_MASK = 0xffff,
     FLAG_MASK = 0x3,
-    DEPTH_MASK = 0x7f,
+    DEPTH_MASK = 0xff,
+    AGE_MASK = 0x3f,
 
-    CLUSTER_SIZE = 4
+    CLUSTER_SIZE = 6
 };
 
+// Depth of the entries stored by qsearch, below any main search depth
+constexpr int DEPTH_QS = 0;
+
+// Static eval of an entry stored without one
+constexpr int EVAL_NONE = -INFINITY;
+
+// Snapshot of an entry. All the fields are packed in one 64-bit word next
+// to a 16-bit check, which is the low 16 bits of the key xored with a fold
+// of the data so that torn writes read as a miss.
 struct TTEntry
 {
     TTEntry();
-    std::uint64_t get_key() const;
-    std::uint32_t get_move() const;
-    void set(std::uint64_t move, std::uint64_t flag, std::uint64_t depth,
-             std::uint64_t score, std::uint64_t key);
+    bool matches(std::uint64_t key) const;
+    u16 get_move() const;
+    void set(u16 move, int flag, int depth, int score, int eval,
+             std::uint64_t key, int age);
     int get_flag() const;
     int get_depth() const;
+    int get_age() const;
     int get_score() const;
+    int get_eval() const;
+    int replacement_score(int generation) const;
     void clear();
 
 private:
-    std::uint64_t key;
+    friend struct TTCluster;
+
+    static u16 fold(std::uint64_t data);
+
+    u16 check;
     std::uint64_t data;
 };
 
 inline TTEntry::TTEntry() {}
-inline void TTEntry::set(std::uint64_t move, std::uint64_t flag,
-                         std::uint64_t depth, std::uint64_t score,
-                         std::uint64_t key)
+inline u16 TTEntry::fold(std::uint64_t data)
+{
+    return u16(data ^ (data >> 16) ^ (data >> 32) ^ (data >> 48));
+}
+inline void TTEntry::set(u16 move, int flag, int depth, int score, int eval,
+                         std::uint64_t key, int age)
+{
+    data = std::uint64_t(move)
+         | (std::uint64_t(u16(score)) << SCORE_SHIFT)
+         | (std::uint64_t(u16(eval)) << EVAL_SHIFT)
+         | (std::uint64_t(depth) << DEPTH_SHIFT)
+         | (std::uint64_t(flag) << FLAG_SHIFT)
+         | (std::uint64_t(age) << AGE_SHIFT);
+    check = u16(key) ^ fold(data);
+}
+// The bucket index comes from the high bits of the key, so the check uses
+// the low ones. Empty entries have no flag and never match.
+inline bool TTEntry::matches(std::uint64_t key) const
 {
-    data = move | (flag << FLAG_SHIFT) | (depth << DEPTH_SHIFT) | (score << SCORE_SHIFT);
-    this->key = key ^ data;
+    return u16(check ^ fold(data)) == u16(key) && get_flag();
 }
-inline std::uint64_t TTEntry::get_key() const { return key ^ data; }
-inline std::uint32_t TTEntry::get_move() const { return std::uint32_t(data & MOVE_MASK); }
+inline u16 TTEntry::get_move() const { return u16(data & MOVE_MASK); }
 inline int TTEntry::get_flag() const { return (data >> FLAG_SHIFT) & FLAG_MASK; }
 inline int TTEntry::get_depth() const { return (data >> DEPTH_SHIFT) & DEPTH_MASK; }
-inline int TTEntry::get_score() const { return int(data >> SCORE_SHIFT); }
-inline void TTEntry::clear() { key = data = 0; }
+inline int TTEntry::get_age() const { return (data >> AGE_SHIFT) & AGE_MASK; }
+inline int TTEntry::get_score() const { return std::int16_t(data >> SCORE_SHIFT); }
+inline int TTEntry::get_eval() const { return std::int16_t(data >> EVAL_SHIFT); }
+inline void TTEntry::clear() { check = 0; data = 0; }
 
-struct TTCluster
+// How much an entry is worth keeping, each search it has survived counts as
+// much as a few plies of depth and exact bounds are kept over other bounds
+inline int TTEntry::replacement_score(int generation) const
 {
-    TTEntry& get_entry(std::uint64_t key);
-    void clear();
+    int age = (generation - get_age()) & AGE_MASK;
+    return get_depth() - 8 * age + 2 * (get_flag() == FLAG_EXACT);
+}
+
+// Six entries in one cache line. The halves of an entry are kept in
+// separate arrays so both stay naturally aligned, and are accessed with
+// relaxed atomics.
+struct alignas(64) TTCluster
+{
+    bool probe(std::uint64_t key, TTEntry& entry) const;
+    int replace(std::uint64_t key, int generation) const;
+    TTEntry load(int i) const;
+    void store(int i, const TTEntry& entry);
 
 private:
-    TTEntry entries[CLUSTER_SIZE];
+    std::atomic<std::uint64_t> data[CLUSTER_SIZE];
+    std::atomic<u16> checks[CLUSTER_SIZE];
 };
 
-inline TTEntry& TTCluster::get_entry(std::uint64_t key)
+static_assert(sizeof(TTCluster) == 64, "TT clusters must fill a cache line");
+
+inline TTEntry TTCluster::load(int i) const
 {
-    // If any entry key matches, return it
-    for (TTEntry& entry : entries) {
-        if (entry.get_key() == key)
-            return entry;
-    }
-    // Otherwise, return entry with minimum depth in cluster
-    int min_depth_index = 0;
-    for (int i = 1; i < CLUSTER_SIZE; ++i) {
-        if (entries[i].get_depth() < entries[min_depth_index].get_depth())
-            min_depth_index = i;
+    TTEntry entry;
+    entry.check = checks[i].load(std::memory_order_relaxed);
+    entry.data = data[i].load(std::memory_order_relaxed);
+    return entry;
+}
+
+inline void TTCluster::store(int i, const TTEntry& entry)
+{
+    checks[i].store(entry.check, std::memory_order_relaxed);
+    data[i].store(entry.data, std::memory_order_relaxed);
+}
+
+// Read only lookup of the entry matching the key
+inline bool TTCluster::probe(std::uint64_t key, TTEntry& entry) const
+{
+    for (int i = 0; i < CLUSTER_SIZE; ++i) {
+        entry = load(i);
+        if (entry.matches(key))
+            return true;
     }
-    return entries[min_depth_index];
+    return false;
 }
 
-inline void TTCluster::clear()
+// Index of the entry to overwrite when storing the key
+inline int TTCluster::replace(std::uint64_t key, int generation) const
 {
-    for (TTEntry& entry : entries)
-        entry.clear();
+    // If any entry key matches, replace it
+    int worst_index = 0;
+    int worst_score = 0;
+    for (int i = 0; i < CLUSTER_SIZE; ++i) {
+        TTEntry entry = load(i);
+        if (entry.matches(key))
+            return i;
+        // Otherwise, replace the least valuable entry in cluster
+        int score = entry.replacement_score(generation);
+        if (!i || score < worst_score)
+        {
+            worst_score = score;
+            worst_index = i;
+        }
+    }
+    return worst_index;
 }
 
 struct TranspositionTable
 {
     TranspositionTable();
     ~TranspositionTable();
-    TranspositionTable(int MB);
-    void resize(int MB);
-    TTEntry probe(std::uint64_t key) const;
-    void write(std::uint64_t move, std::uint64_t flag, std::uint64_t depth,
-               std::uint64_t score, std::uint64_t key);
+    TranspositionTable(std::size_t MB);
+    void resize(std::size_t MB);
+    bool probe(std::uint64_t key, TTEntry& entry) const;
+    void prefetch(std::uint64_t key) const;
+    void write(Move move, int flag, int depth, int score, int eval,
+               std::uint64_t key);
     void clear();
-    int hash(std::uint64_t key) const;
+    void new_search();
+    std::size_t hash(std::uint64_t key) const;
 
 private:
-    TTCluster* table;
-    int size;
-};
+    void allocate(std::size_t MB);
+    void release();
+    void first_touch();
+    void for_each_slice(
+            const std::function<void(std::size_t, std::size_t)>& job);
 
-inline TranspositionTable::TranspositionTable()
-{
-    size = (1 << 20) / sizeof(TTCluster);
-    table = new TTCluster[size];
-    clear();
-}
+    TTCluster* table = nullptr;
+    std::size_t size = 0;
+    std::size_t mapped = 0;
+    int generation = 0;
+};
 
-inline TranspositionTable::~TranspositionTable()
+// Ages every entry by one search, without touching the table
+inline void TranspositionTable::new_search()
 {
-    delete[] table;
+    generation = (generation + 1) & AGE_MASK;
 }
 
-inline TranspositionTable::TranspositionTable(int MB)
+// Maps the key uniformly onto [0, size) with a multiply-high, which is much
+// cheaper than a 64-bit modulo and works for any table size
+inline std::size_t TranspositionTable::hash(std::uint64_t key) const
 {
-    resize(MB);
+#ifdef __SIZEOF_INT128__
+    return std::size_t((unsigned __int128)key * size >> 64);
+#else
+    // High half of the 64x64 product from 32-bit halves
+    std::uint64_t n = size;
+    std::uint64_t key_lo = std::uint32_t(key), key_hi = key >> 32;
+    std::uint64_t n_lo = std::uint32_t(n), n_hi = n >> 32;
+    std::uint64_t lo_lo = key_lo * n_lo;
+    std::uint64_t hi_lo = key_hi * n_lo;
+    std::uint64_t lo_hi = key_lo * n_hi;
+    std::uint64_t cross = (lo_lo >> 32) + std::uint32_t(hi_lo) + lo_hi;
+    return std::size_t(key_hi * n_hi + (hi_lo >> 32) + (cross >> 32));
+#endif
 }
 
-inline void TranspositionTable::resize(int MB)
+// Leaves a cleared entry on a miss
+inline bool TranspositionTable::probe(std::uint64_t key, TTEntry& entry) const
 {
-    if (MB <= 0)
-        MB = 1;
-
-    size = ((1 << 20) / sizeof(TTCluster)) * MB;
-    delete[] table;
-    table = new TTCluster[size];
-    clear();
+    if (table[hash(key)].probe(key, entry))
+        return true;
+    entry.clear();
+    return false;
 }
 
-inline void TranspositionTable::clear()
+// Starts loading the cluster of a key that is about to be probed
+inline void TranspositionTable::prefetch(std::uint64_t key) const
 {
-    for (int i = 0; i < size; ++i)
-        table[i].clear();
+    __builtin_prefetch(&table[hash(key)]);
 }
 
-inline int TranspositionTable::hash(std::uint64_t key) const
+inline void TranspositionTable::write(Move move, int flag, int depth,
+                                      int score, int eval, std::uint64_t key)
 {
-    return key % size;
-}
+    TTCluster& cluster = table[hash(key)];
+    int index = cluster.replace(key, generation);
+    u16 tt_move = compress_move(move);
 
-inline TTEntry TranspositionTable::probe(std::uint64_t key) const
-{
-    int index = hash(key);
-    return table[index].get_entry(key);
-}
+    TTEntry entry = cluster.load(index);
+    if (entry.matches(key))
+    {
+        // A qsearch result is worth less than a deeper search of the same
+        // position, and a store without a move keeps the one found before
+        if (depth == DEPTH_QS && entry.get_depth() > DEPTH_QS)
+            return;
+        if (!tt_move)
+            tt_move = entry.get_move();
+    }
 
-inline void TranspositionTable::write(
-        std::uint64_t move, std::uint64_t flag, std::uint64_t depth,
-        std::uint64_t score, std::uint64_t key
-        )
-{
-    int index = hash(key);
-    table[index].get_entry(key).set(move, flag, depth, score, key);
+    entry.set(tt_move, flag, depth, score, eval, key, generation);
+    cluster.store(index, entry);
 }
 
 inline TranspositionTable tt;
@@ -22,17 +22,21 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
 SOFTWARE.
 */
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <string>
 #include <sstream>
 #include <thread>
 
 #include "tt.h"
 #include "uci.h"
+#include "perft.h"
 #include "mcts.h"
 #include "options.h"
 #include "position.h"
 #include "controller.h"
+#include "threadpool.h"
 
 #define INITIAL_POSITION ("rnbqkbnr/pppppppp/8/8/8/8/PPPPPPPP/RNBQKBNR w KQkq - 0 1")
 
@@ -40,10 +44,10 @@ volatile bool searching = false;
 
 Move get_parsed_move(Position& pos, std::string& move_str)
 {
-    std::vector<Move> mlist;
+    MoveList mlist;
     pos.generate_movelist(mlist);
     for (Move move : mlist) {
-        if (get_move_string(move, pos.is_flipped()) == move_str)
+        if (get_move_string(move) == move_str)
             return move;
     }
     std::cout << "CANNOT PARSE MOVE " << move_str << "!" << std::endl;
@@ -100,23 +104,85 @@ namespace handler
             continue;
     }
 
+    // Optional "threads <n>", "hash <mb>", "depth <max>" and "divide" perft
+    // arguments
+    std::unique_ptr<PerftTable> perft_args(std::stringstream& stream,
+                                           int& threads, int& max_depth,
+                                           bool& divide)
+    {
+        threads = options::spins["Threads"].value;
+        max_depth = MAX_PLY;
+        divide = false;
+        int hash_mb = 0;
+        std::string word;
+        while (stream >> word) {
+            if (word == "threads")
+                stream >> threads;
+            else if (word == "hash")
+                stream >> hash_mb;
+            else if (word == "depth")
+                stream >> max_depth;
+            else if (word == "divide")
+                divide = true;
+        }
+        threads = std::clamp(threads, 1, MAX_THREADS);
+        std::cout << "info string perft threads " << threads
+                  << " hash " << std::max(hash_mb, 0) << std::endl;
+        if (hash_mb > 0)
+            return std::make_unique<PerftTable>(hash_mb);
+        return nullptr;
+    }
+
+    // Perft runs on the search thread pool, sized to its own thread count
+    // for the length of the command
+    void resize_pool(int threads)
+    {
+        if (thread_pool.size() != threads)
+            thread_pool.resize(threads);
+    }
+
+    // perft <depth> [threads <n>] [hash <mb>] [divide]
     void perft(Position& pos, std::stringstream& stream)
     {
         int depth;
         if (!(stream >> depth))
             depth = 1;
 
+        int threads, max_depth;
+        bool divide;
+        auto table = perft_args(stream, threads, max_depth, divide);
+        stop();
+        resize_pool(threads);
+
         u64 count = u64(1);
         for (int d = 1; d <= depth; ++d) {
             time_ms t1 = utils::curr_time();
-            count = pos.perft(d);
+            count = perft::count(pos, d, threads, table.get(),
+                                 divide && d == depth);
             time_ms t2 = utils::curr_time();
             std::cout << "info depth " << d
                       << " time " << (t2 - t1)
                       << " nodes " << count
+                      << " mnps " << (t2 > t1 ? count / 1000.0 / (t2 - t1) : 0.0)
                       << std::endl;
         }
         std::cout << "nodes " << count << std::endl;
+        resize_pool(options::spins["Threads"].value);
+    }
+
+    // perftsuite <epd-file> [depth <max>] [threads <n>] [hash <mb>]
+    void perftsuite(std::stringstream& stream)
+    {
+        std::string path;
+        stream >> path;
+
+        int threads, max_depth;
+        bool divide;
+        auto table = perft_args(stream, threads, max_depth, divide);
+        stop();
+        resize_pool(threads);
+        perft::suite(path, threads, table.get(), max_depth);
+        resize_pool(options::spins["Threads"].value);
     }
 
     void setoption(std::stringstream& stream)
@@ -176,10 +242,13 @@ namespace handler
         }
     }
 
-    void position(Position& pos, std::stringstream& stream)
+    void position(Position& pos, HashHistory& history,
+                  std::stringstream& stream)
     {
         handler::stop();
 
+        history.clear();
+
         std::string word;
         stream >> word;
         if (word == "startpos")
@@ -195,12 +264,14 @@ namespace handler
         if (stream >> word && word == "moves")
         {
             std::string move_str;
-            while (stream >> move_str)
+            while (stream >> move_str) {
+                history.push(pos.get_hash_key());
                 pos.make_move(get_parsed_move(pos, move_str));
+            }
         }
     }
 
-    void go(Position& pos, std::stringstream& stream)
+    void go(Position& pos, HashHistory& history, std::stringstream& stream)
     {
         std::string word;
         controller.stop_search = false;
@@ -210,6 +281,7 @@ namespace handler
         controller.max_ply = MAX_PLY;
         controller.start_time = utils::curr_time();
         controller.end_time = controller.start_time;
+        tt.new_search();
         time_ms time_to_go = 1000;
         int moves_to_go = 35,
             increment = 0;
@@ -232,7 +304,7 @@ namespace handler
                 controller.time_dependent = true;
                 time_ms wtime;
                 stream >> wtime;
-                if (!pos.is_flipped())
+                if (pos.get_side() == WHITE)
                     time_to_go = wtime;
             }
             else if (word == "btime")
@@ -240,7 +312,7 @@ namespace handler
                 controller.time_dependent = true;
                 time_ms btime;
                 stream >> btime;
-                if (pos.is_flipped())
+                if (pos.get_side() == BLACK)
                     time_to_go = btime;
             }
             else if (word == "winc")
@@ -248,7 +320,7 @@ namespace handler
                 controller.time_dependent = true;
                 time_ms winc;
                 stream >> winc;
-                if (!pos.is_flipped())
+                if (pos.get_side() == WHITE)
                     increment = winc;
             }
             else if (word == "binc")
@@ -256,7 +328,7 @@ namespace handler
                 controller.time_dependent = true;
                 time_ms binc;
                 stream >> binc;
-                if (pos.is_flipped())
+                if (pos.get_side() == BLACK)
                     increment = binc;
             }
             else if (word == "searchmoves")
@@ -293,21 +365,21 @@ namespace handler
         if (!searching)
         {
             searching = true;
-            std::thread search_thread([&pos]() {
+            std::thread search_thread([&pos, &history]() {
                 if (mcts)
                 {
-                    GameTree gt {pos};
+                    GameTree gt {pos, history};
                     gt.search();
                 }
                 else
                 {
-                    auto bestmove = pos.best_move();
+                    auto bestmove = pos.best_move(history);
                     std::cout << "bestmove "
-                              << get_move_string(bestmove.first, pos.is_flipped());
+                              << get_move_string(bestmove.first);
                     if (allow_ponder && bestmove.second)
                     {
                         std::cout << " ponder "
-                                  << get_move_string(bestmove.second, !pos.is_flipped());
+                                  << get_move_string(bestmove.second);
                     }
                     std::cout << std::endl;
                 }
@@ -327,6 +399,7 @@ namespace handler
 void loop()
 {
     Position pos;
+    HashHistory history;
     std::stringstream stream {INITIAL_POSITION};
     pos.init(stream);
     std::string line, word;
@@ -341,8 +414,9 @@ void loop()
         else if (word == "setoption") handler::setoption(stream);
         else if (word == "isready") handler::isready();
         else if (word == "perft") handler::perft(pos, stream);
-        else if (word == "position") handler::position(pos, stream);
-        else if (word == "go") handler::go(pos, stream);
+        else if (word == "perftsuite") handler::perftsuite(stream);
+        else if (word == "position") handler::position(pos, history, stream);
+        else if (word == "go") handler::go(pos, history, stream);
         else if (word == "ponderhit") handler::ponderhit();
         else if (word == "stop") handler::stop();
         else if (word == "quit") break;
@@ -358,7 +432,7 @@ namespace uci
         loop();
     }
 
-    void print_currmove(Move move, int move_num, time_ms start_time, bool flipped)
+    void print_currmove(Move move, int move_num, time_ms start_time)
     {
         time_ms curr_time = utils::curr_time();
         time_ms time_passed = curr_time - start_time;
@@ -366,7 +440,7 @@ namespace uci
         {
             std::cout << "info"
                       << " currmovenumber " << move_num
-                      << " currmove " << get_move_string(move, flipped)
+                      << " currmove " << get_move_string(move)
                       << " nodes " << controller.nodes_searched
                       << " time " << time_passed
                       << std::endl;
@@ -374,7 +448,7 @@ namespace uci
     }
 
     void print_search(int score, int depth, int bound, time_ms time,
-                      std::vector<Move>& pv, bool flipped)
+                      std::vector<Move>& pv)
     {
         std::cout << "info";
         std::cout << " score ";
@@ -400,15 +474,15 @@ namespace uci
         std::cout << " time " << time;
         if (time > 1000)
             std::cout << " nps " << (controller.nodes_searched * 1000) / time;
-        std::cout << " pv " << get_pv_string(pv, flipped);
+        std::cout << " pv " << get_pv_string(pv);
         std::cout << std::endl;
     }
 
-    std::string get_pv_string(std::vector<Move>& pv, bool flipped)
+    std::string get_pv_string(std::vector<Move>& pv)
     {
         std::string pv_string = "";
-        for (unsigned i = 0; i < pv.size(); ++i, flipped = !flipped) {
-            pv_string += get_move_string(pv[i], flipped);
+        for (unsigned i = 0; i < pv.size(); ++i) {
+            pv_string += get_move_string(pv[i]);
             if (i != pv.size() - 1)
                 pv_string += " ";
         }
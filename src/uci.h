@@ -37,11 +37,10 @@ SOFTWARE.
 namespace uci
 {
     extern void init();
-    extern void print_currmove(Move move, int move_num, time_ms start_time,
-                               bool flipped);
+    extern void print_currmove(Move move, int move_num, time_ms start_time);
     extern void print_search(int score, int depth, int bound, time_ms time,
-                             std::vector<Move>& pv, bool flipped);
-    extern std::string get_pv_string(std::vector<Move>& pv, bool flipped);
+                             std::vector<Move>& pv);
+    extern std::string get_pv_string(std::vector<Move>& pv);
 }
 
 #endif